@@ -0,0 +1,553 @@
+#include "anim.h"
+#include "memory.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+static inline double now_ms() noexcept {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//+Diff
+  tile_rect changed_rect(const u_char* prev, const u_char* next, uint width, uint height) noexcept {
+    const uint32_t* a = (const uint32_t*)prev;
+    const uint32_t* b = (const uint32_t*)next;
+
+    std::vector<std::pair<uint, uint>> spans(height, { width, 0 });
+
+    jobs().parallel_for(0, height, 64, [&](size_t begin, size_t end) {
+      for (size_t y = begin; y < end; y++) {
+        const uint32_t* ra = a + y * width;
+        const uint32_t* rb = b + y * width;
+
+        // Branch free OR reduction vectorizes, most rows are equal
+        uint32_t any = 0;
+        for (uint x = 0; x < width; x++) any |= ra[x] ^ rb[x];
+        if (!any) continue;
+
+        uint left = 0, right = width - 1;
+        while (ra[left] == rb[left]) left++;
+        while (ra[right] == rb[right]) right--;
+
+        spans[y] = { left, right + 1 };
+      }
+    });
+
+    uint x0 = width, x1 = 0, y0 = height, y1 = 0;
+    for (uint y = 0; y < height; y++) {
+      if (spans[y].first >= spans[y].second) continue;
+
+      x0 = std::min(x0, spans[y].first);
+      x1 = std::max(x1, spans[y].second);
+      y0 = std::min(y0, y);
+      y1 = y + 1;
+    }
+
+    if (x0 >= x1) return { 0, 0, 0, 0 };
+    return { x0, y0, x1 - x0, y1 - y0 };
+  }
+//-Diff
+
+//+Palette
+  // Median cut over a 5-5-5 histogram: every split halves the box with the
+  // biggest weighted extent along its longest axis, which makes the boxes a
+  // k-d tree over colour space.
+  struct palette {
+    std::array<u_char, 256 * 3> colors = {};
+    uint size = 0;
+    std::vector<u_char> lut = std::vector<u_char>(1 << 15, 0);
+  };
+
+  static inline uint rgb15(const u_char* px) noexcept {
+    return (px[0] >> 3) << 10 | (px[1] >> 3) << 5 | (px[2] >> 3);
+  }
+
+  static inline uint channel(uint c15, uint axis) noexcept {
+    return (c15 >> (10 - axis * 5)) & 31;
+  }
+
+  static palette build_palette(const u_char* rgba, uint stride, tile_rect r) noexcept {
+    std::vector<uint32_t> hist(1 << 15, 0);
+    std::mutex merge;
+
+    jobs().parallel_for(0, r.height, 64, [&](size_t begin, size_t end) {
+      std::vector<uint32_t> local(1 << 15, 0);
+
+      for (size_t y = begin; y < end; y++) {
+        const u_char* row = rgba + (r.y + y) * stride + r.x * 4;
+        for (uint x = 0; x < r.width; x++) local[rgb15(row + x * 4)]++;
+      }
+
+      std::lock_guard lock(merge);
+      for (uint i = 0; i < (1 << 15); i++) hist[i] += local[i];
+    });
+
+    std::vector<std::pair<uint16_t, uint32_t>> entries;
+    for (uint i = 0; i < (1 << 15); i++)
+      if (hist[i]) entries.push_back({ (uint16_t)i, hist[i] });
+
+    struct box { size_t begin, end; uint64_t weight; uint axis; uint extent; };
+
+    auto measure = [&](size_t begin, size_t end) {
+      uint lo[3] = { 31, 31, 31 }, hi[3] = {};
+      uint64_t weight = 0;
+
+      for (size_t i = begin; i < end; i++) {
+        for (uint a = 0; a < 3; a++) {
+          lo[a] = std::min(lo[a], channel(entries[i].first, a));
+          hi[a] = std::max(hi[a], channel(entries[i].first, a));
+        }
+        weight += entries[i].second;
+      }
+
+      uint axis = 0;
+      for (uint a = 1; a < 3; a++) if (hi[a] - lo[a] > hi[axis] - lo[axis]) axis = a;
+
+      return box { begin, end, weight, axis, hi[axis] - lo[axis] };
+    };
+
+    std::vector<box> boxes = { measure(0, entries.size()) };
+
+    while (boxes.size() < 256) {
+      auto it = std::max_element(boxes.begin(), boxes.end(), [](const box& l, const box& r) {
+        return (uint64_t)l.extent * l.weight < (uint64_t)r.extent * r.weight;
+      });
+
+      if (it->extent == 0 || it->end - it->begin < 2) break;
+
+      auto b = *it;
+      std::sort(entries.begin() + b.begin, entries.begin() + b.end, [&](auto& l, auto& r) {
+        return channel(l.first, b.axis) < channel(r.first, b.axis);
+      });
+
+      // Weighted median, both halves keep at least one colour
+      uint64_t acc = 0;
+      size_t split = b.begin + 1;
+      for (size_t i = b.begin; i < b.end - 1; i++) {
+        acc += entries[i].second;
+        split = i + 1;
+        if (acc * 2 >= b.weight) break;
+      }
+
+      *it = measure(b.begin, split);
+      boxes.push_back(measure(split, b.end));
+    }
+
+    palette p;
+    p.size = std::max<size_t>(boxes.size(), 1);
+
+    for (size_t i = 0; i < boxes.size(); i++) {
+      uint64_t sum[3] = {};
+
+      for (size_t e = boxes[i].begin; e < boxes[i].end; e++) {
+        for (uint a = 0; a < 3; a++) sum[a] += (uint64_t)(channel(entries[e].first, a) << 3 | 4) * entries[e].second;
+        p.lut[entries[e].first] = i;
+      }
+
+      for (uint a = 0; a < 3; a++) p.colors[i * 3 + a] = boxes[i].weight ? sum[a] / boxes[i].weight : 0;
+    }
+
+    return p;
+  }
+//-Palette
+
+//+GIF
+  // Variable width LZW as GIF wants it, packed into 255 byte sub-blocks
+  class lzw_writer {
+    std::vector<u_char>& _out;
+    std::array<u_char, 255> _block;
+    uint _block_size = 0;
+    uint32_t _bits = 0;
+    uint _bit_count = 0;
+
+    void _byte(u_char b) noexcept {
+      _block[_block_size++] = b;
+      if (_block_size == 255) flush_block();
+    }
+
+  public:
+    explicit lzw_writer(std::vector<u_char>& out) noexcept : _out(out) {}
+
+    void code(uint c, uint size) noexcept {
+      _bits |= c << _bit_count;
+      _bit_count += size;
+
+      while (_bit_count >= 8) {
+        _byte(_bits & 0xFF);
+        _bits >>= 8;
+        _bit_count -= 8;
+      }
+    }
+
+    void flush_block() noexcept {
+      if (!_block_size) return;
+      _out.push_back(_block_size);
+      _out.insert(_out.end(), _block.begin(), _block.begin() + _block_size);
+      _block_size = 0;
+    }
+
+    void finish() noexcept {
+      if (_bit_count) _byte(_bits & 0xFF);
+      flush_block();
+      _out.push_back(0);
+    }
+  };
+
+  static void lzw_encode(const u_char* indices, size_t n, std::vector<u_char>& out) noexcept {
+    constexpr uint MIN_CODE = 8, CLEAR = 256, EOI = 257, TABLE = 1 << 13;
+
+    // Open addressing dictionary (prefix, byte) -> code, generation stamps instead of clearing
+    std::vector<uint32_t> keys(TABLE), stamps(TABLE, 0);
+    std::vector<uint16_t> codes(TABLE);
+    uint32_t generation = 1;
+
+    out.push_back(MIN_CODE);
+    lzw_writer w(out);
+
+    uint size = MIN_CODE + 1, next = EOI;
+    w.code(CLEAR, size);
+
+    if (!n) { w.code(EOI, size); w.finish(); return; }
+
+    uint prefix = indices[0];
+
+    for (size_t i = 1; i < n; i++) {
+      uint32_t key = prefix << 8 | indices[i];
+      uint slot = (key * 2654435761u) >> 19;
+
+      while (stamps[slot] == generation && keys[slot] != key) slot = (slot + 1) & (TABLE - 1);
+
+      if (stamps[slot] == generation) {
+        prefix = codes[slot];
+        continue;
+      }
+
+      w.code(prefix, size);
+
+      stamps[slot] = generation;
+      keys[slot] = key;
+      codes[slot] = ++next;
+
+      if (next >= (1u << size)) size++;
+
+      if (next == 4095) {
+        w.code(CLEAR, size);
+        generation++;
+        size = MIN_CODE + 1;
+        next = EOI;
+      }
+
+      prefix = indices[i];
+    }
+
+    w.code(prefix, size);
+    w.code(EOI, size);
+    w.finish();
+  }
+
+  static inline void put16(std::vector<u_char>& out, uint v) noexcept {
+    out.push_back(v & 0xFF);
+    out.push_back(v >> 8);
+  }
+
+  // Graphic control + image descriptor + local palette + LZW data of one frame
+  static void encode_gif_frame(const Image& image, tile_rect r, uint delay_ms, std::vector<u_char>& out) noexcept {
+    const uint stride = image.width * 4;
+    const u_char* rgba = (const u_char*)image.data;
+
+    auto p = build_palette(rgba, stride, r);
+
+    std::vector<u_char> indices((size_t)r.width * r.height);
+    jobs().parallel_for(0, r.height, 64, [&](size_t begin, size_t end) {
+      for (size_t y = begin; y < end; y++) {
+        const u_char* row = rgba + (r.y + y) * stride + r.x * 4;
+        for (uint x = 0; x < r.width; x++) indices[y * r.width + x] = p.lut[rgb15(row + x * 4)];
+      }
+    });
+
+    // Disposal 1: keep, next frame only overwrites its own rectangle
+    out.insert(out.end(), { 0x21, 0xF9, 0x04, 0x04 });
+    put16(out, (delay_ms + 5) / 10);
+    out.insert(out.end(), { 0x00, 0x00 });
+
+    out.push_back(0x2C);
+    put16(out, r.x);
+    put16(out, r.y);
+    put16(out, r.width);
+    put16(out, r.height);
+    out.push_back(0x80 | 7); // local table of 256 entries
+
+    out.insert(out.end(), p.colors.begin(), p.colors.end());
+
+    lzw_encode(indices.data(), indices.size(), out);
+  }
+//-GIF
+
+//+APNG
+  static constexpr auto CRC_TABLE = []() {
+    std::array<uint32_t, 256> table = {};
+
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+
+    return table;
+  }();
+
+  static uint32_t crc32(uint32_t crc, const u_char* data, size_t n) noexcept {
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = CRC_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+  }
+
+  static uint32_t adler32(const u_char* data, size_t n) noexcept {
+    uint32_t a = 1, b = 0;
+
+    while (n) {
+      // 5552 is the largest block which can't overflow b
+      size_t block = std::min<size_t>(n, 5552);
+      n -= block;
+
+      while (block--) { a += *data++; b += a; }
+
+      a %= 65521;
+      b %= 65521;
+    }
+
+    return b << 16 | a;
+  }
+
+  static inline void put32be(std::vector<u_char>& out, uint32_t v) noexcept {
+    out.insert(out.end(), { (u_char)(v >> 24), (u_char)(v >> 16), (u_char)(v >> 8), (u_char)v });
+  }
+
+  static inline void put16be(std::vector<u_char>& out, uint v) noexcept {
+    out.insert(out.end(), { (u_char)(v >> 8), (u_char)v });
+  }
+
+  static void write_chunk(FILE* out, const char type[4], const std::vector<u_char>& data) noexcept {
+    std::vector<u_char> head;
+    put32be(head, data.size());
+    fwrite(head.data(), 1, 4, out);
+
+    auto crc = crc32(0, (const u_char*)type, 4);
+    crc = crc32(crc, data.data(), data.size());
+
+    fwrite(type, 1, 4, out);
+    fwrite(data.data(), 1, data.size(), out);
+
+    head.clear();
+    put32be(head, crc);
+    fwrite(head.data(), 1, 4, out);
+  }
+
+  // Rows filtered with whichever of None / Sub / Up has the smallest absolute sum, then zlib
+  static void encode_apng_frame(const Image& image, tile_rect r, std::vector<u_char>& out) noexcept {
+    const size_t stride = (size_t)image.width * 4;
+    const size_t row_bytes = (size_t)r.width * 4;
+    const u_char* rgba = (const u_char*)image.data;
+
+    std::vector<u_char> filtered((row_bytes + 1) * r.height);
+
+    jobs().parallel_for(0, r.height, 32, [&](size_t begin, size_t end) {
+      std::vector<u_char> candidates[3] = { std::vector<u_char>(row_bytes), std::vector<u_char>(row_bytes), std::vector<u_char>(row_bytes) };
+
+      for (size_t y = begin; y < end; y++) {
+        const u_char* row = rgba + (r.y + y) * stride + r.x * 4;
+        const u_char* up  = y ? row - stride : nullptr;
+
+        uint64_t sums[3] = {};
+        for (size_t i = 0; i < row_bytes; i++) {
+          u_char none = row[i];
+          u_char sub  = row[i] - (i >= 4 ? row[i - 4] : 0);
+          u_char upf  = row[i] - (up ? up[i] : 0);
+
+          candidates[0][i] = none; sums[0] += std::abs((int8_t)none);
+          candidates[1][i] = sub;  sums[1] += std::abs((int8_t)sub);
+          candidates[2][i] = upf;  sums[2] += std::abs((int8_t)upf);
+        }
+
+        uint best = std::min_element(sums, sums + 3) - sums;
+        u_char* dst = filtered.data() + y * (row_bytes + 1);
+        dst[0] = best;
+        memcpy(dst + 1, candidates[best].data(), row_bytes);
+      }
+    });
+
+    int size = 0;
+    u_char* deflated = CompressData(filtered.data(), filtered.size(), &size);
+
+    out.insert(out.end(), { 0x78, 0x01 });
+    out.insert(out.end(), deflated, deflated + size);
+    put32be(out, adler32(filtered.data(), filtered.size()));
+
+    MemFree(deflated);
+  }
+//-APNG
+
+anim_encoder::anim_encoder(const char* path, uint delay_ms) noexcept
+  : _path(path),
+    _format(_path.ends_with(".gif") ? format::GIF : format::APNG),
+    _delay_ms(delay_ms) {}
+
+anim_encoder::~anim_encoder() noexcept {
+  for (auto& f : _frames) {
+    jobs().wait(f->encoded);
+    jobs().wait(f->released);
+
+    track_cpu(mem_cpu::EXPORT, -(ssize_t)(image_bytes(f->image) + f->data.size()));
+    if (f->image.data) UnloadImage(f->image);
+  }
+}
+
+void anim_encoder::add_frame(Image image) noexcept {
+  // Caller counted the image as it came, conversions below may resize it
+  const ssize_t handed_over = image_bytes(image);
+
+  ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+  if (_frames.empty()) {
+    _width = image.width;
+    _height = image.height;
+  } else if ((uint)image.width != _width || (uint)image.height != _height) {
+    ImageResizeCanvas(&image, _width, _height, 0, 0, BLANK);
+  }
+
+  track_cpu(mem_cpu::EXPORT, image_bytes(image) - handed_over);
+
+  auto f = std::make_unique<frame>();
+  f->image = image;
+
+  frame* prev = _frames.empty() ? nullptr : _frames.back().get();
+  frame* self = f.get();
+
+  auto fmt = _format;
+  auto delay = _delay_ms;
+
+  f->encoded = jobs().submit_background([self, prev, fmt, delay]() {
+    auto start = now_ms();
+    auto& img = self->image;
+
+    self->rect = prev
+      ? changed_rect((const u_char*)prev->image.data, (const u_char*)img.data, img.width, img.height)
+      : tile_rect { 0, 0, (uint)img.width, (uint)img.height };
+
+    // Nothing changed, still a frame to hold the delay
+    if (!self->rect.width) self->rect = { 0, 0, 1, 1 };
+
+    if (fmt == format::GIF) encode_gif_frame(img, self->rect, delay, self->data);
+    else encode_apng_frame(img, self->rect, self->data);
+
+    track_cpu(mem_cpu::EXPORT, self->data.size());
+
+    self->encode_ms = now_ms() - start;
+  });
+
+  // Pixels of previous frame are needed until both neighbours are encoded
+  if (prev) {
+    prev->released = jobs().submit_background([prev]() {
+      track_cpu(mem_cpu::EXPORT, -(ssize_t)image_bytes(prev->image));
+      UnloadImage(prev->image);
+      prev->image.data = nullptr;
+    }, { prev->encoded, f->encoded });
+  }
+
+  _frames.push_back(std::move(f));
+}
+
+bool anim_encoder::_write_gif(FILE* out) noexcept {
+  std::vector<u_char> head = { 'G', 'I', 'F', '8', '9', 'a' };
+  put16(head, _width);
+  put16(head, _height);
+  head.insert(head.end(), { 0x00, 0x00, 0x00 });
+
+  // NETSCAPE2.0 loop forever
+  head.insert(head.end(), { 0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00 });
+  fwrite(head.data(), 1, head.size(), out);
+
+  for (auto& f : _frames) fwrite(f->data.data(), 1, f->data.size(), out);
+
+  fputc(0x3B, out);
+  return true;
+}
+
+bool anim_encoder::_write_apng(FILE* out) noexcept {
+  static const u_char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  fwrite(signature, 1, sizeof(signature), out);
+
+  std::vector<u_char> chunk;
+  put32be(chunk, _width);
+  put32be(chunk, _height);
+  chunk.insert(chunk.end(), { 8, 6, 0, 0, 0 }); // 8 bit RGBA
+  write_chunk(out, "IHDR", chunk);
+
+  chunk.clear();
+  put32be(chunk, _frames.size());
+  put32be(chunk, 0);
+  write_chunk(out, "acTL", chunk);
+
+  uint seq = 0;
+
+  for (size_t i = 0; i < _frames.size(); i++) {
+    auto& f = *_frames[i];
+
+    chunk.clear();
+    put32be(chunk, seq++);
+    put32be(chunk, f.rect.width);
+    put32be(chunk, f.rect.height);
+    put32be(chunk, f.rect.x);
+    put32be(chunk, f.rect.y);
+    put16be(chunk, _delay_ms);
+    put16be(chunk, 1000);
+    chunk.insert(chunk.end(), { 0, 0 }); // dispose none, blend source
+    write_chunk(out, "fcTL", chunk);
+
+    // First frame doubles as default image
+    if (i == 0) {
+      write_chunk(out, "IDAT", f.data);
+      continue;
+    }
+
+    chunk.clear();
+    put32be(chunk, seq++);
+    chunk.insert(chunk.end(), f.data.begin(), f.data.end());
+    write_chunk(out, "fdAT", chunk);
+  }
+
+  write_chunk(out, "IEND", {});
+  return true;
+}
+
+bool anim_encoder::finish() noexcept {
+  if (_frames.empty()) return false;
+
+  for (auto& f : _frames) jobs().wait(f->encoded);
+
+  FILE* out = fopen(_path.c_str(), "wb");
+  if (!out) return false;
+
+  auto ok = _format == format::GIF ? _write_gif(out) : _write_apng(out);
+  fclose(out);
+
+  return ok;
+}
+
+void anim_encoder::report(FILE* out) noexcept {
+  if (_frames.empty()) return;
+
+  double total = 0, worst = 0;
+  for (auto& f : _frames) {
+    jobs().wait(f->encoded);
+    total += f->encode_ms;
+    worst = std::max(worst, f->encode_ms);
+  }
+
+  fprintf(out, "anim: %zu frames %ux%u into %s, encode avg %.2fms max %.2fms per frame\n",
+    _frames.size(), _width, _height, _path.c_str(), total / _frames.size(), worst);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <raylib.h>
+#include <sys/types.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jobs.h"
+#include "tiles.h"
+
+// Animated GIF / APNG writer. Every added frame is encoded right away as a
+// job: only the rectangle that changed since the previous frame is stored,
+// GIF frames get their own median-cut palette. finish() only waits for the
+// jobs and writes the blocks out in order.
+class anim_encoder {
+  enum class format { GIF, APNG };
+
+  struct frame {
+    Image image;
+    tile_rect rect;
+    std::vector<u_char> data; // GIF: image block, APNG: zlib stream of the rect
+    double encode_ms;
+    job_handle encoded;
+    job_handle released;
+  };
+
+  std::string _path;
+  format _format;
+  uint _delay_ms;
+  uint _width = 0, _height = 0;
+
+  std::vector<std::unique_ptr<frame>> _frames;
+
+  bool _write_gif(FILE* out) noexcept;
+  bool _write_apng(FILE* out) noexcept;
+
+public:
+  // *.gif gives GIF, anything else APNG
+  anim_encoder(const char* path, uint delay_ms) noexcept;
+  ~anim_encoder() noexcept;
+
+  anim_encoder(const anim_encoder&) = delete;
+  anim_encoder& operator=(const anim_encoder&) = delete;
+
+  // Takes ownership of RGBA8 image, frames of other size are cropped / padded to the first one
+  void add_frame(Image image) noexcept;
+
+  inline size_t frames() const noexcept { return _frames.size(); }
+
+  bool finish() noexcept;
+
+  void report(FILE* out) noexcept;
+};
+
+// Bounding box of pixels that differ between two RGBA frames of equal size, empty when equal
+tile_rect changed_rect(const u_char* prev, const u_char* next, uint width, uint height) noexcept;
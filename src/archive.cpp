@@ -0,0 +1,345 @@
+#include "archive.h"
+#include "buffers.h"
+#include "fileio.h"
+#include "jobs.h"
+#include "lz.h"
+#include "tiles.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef DEBUG
+  static int __COUNTER = -1;
+
+  #define LOG(__format_string, ...) do { \
+    printf("%s:%d (%s)@%d : " __format_string, __FILE__, __LINE__, __FUNCTION__, ++__COUNTER, ##__VA_ARGS__); \
+    fflush(stdout); \
+  } while (0)
+#else
+  #define LOG(__format_string, ...) {}
+#endif
+
+static constexpr uint BPP = 4;
+static constexpr char MANIFEST_MAGIC[8] = { 'B', 'O', 'O', 'M', 'E', 'R', '2', 'M' };
+
+struct index_record {
+  uint64_t key;
+  uint64_t offset;
+  uint32_t bytes;
+  uint32_t raw;
+};
+
+struct manifest_header {
+  char magic[8];
+  uint32_t width, height;
+  uint64_t tiles;
+};
+
+// Keeps other processes out of the store, threads of this one are kept apart by _mutex
+struct file_lock {
+  int fd;
+
+  file_lock(int fd, int operation) noexcept : fd(flock(fd, operation) ? -1 : fd) {}
+  ~file_lock() noexcept { if (fd >= 0) flock(fd, LOCK_UN); }
+};
+
+static bool make_dirs(const std::string& path) noexcept {
+  for (size_t i = 1; i <= path.size(); i++) {
+    if (i < path.size() && path[i] != '/') continue;
+
+    auto dir = path.substr(0, i);
+    if (mkdir(dir.c_str(), 0755) && errno != EEXIST) return false;
+  }
+
+  return true;
+}
+
+static size_t file_bytes(const std::string& path) noexcept {
+  struct stat st;
+  return stat(path.c_str(), &st) ? 0 : st.st_size;
+}
+
+// Equal pixels in differently shaped edge tiles must not share a key
+static inline uint64_t tile_key(const u_char* pixels, uint frame_width, tile_rect r) noexcept {
+  uint64_t h = hash_tile(pixels + ((size_t)r.y * frame_width + r.x) * BPP, (size_t)frame_width * BPP, (size_t)r.width * BPP, r.height);
+  return h ^ (((uint64_t)r.width << 40 | (uint64_t)r.height << 20) * 0x9E3779B97F4A7C15ull);
+}
+
+std::string default_archive_dir() noexcept {
+  if (const char* dir = getenv("BOOMER2_ARCHIVE_DIR")) return dir;
+  if (const char* data = getenv("XDG_DATA_HOME")) return std::string(data) + "/boomer2/archive";
+
+  const char* home = getenv("HOME");
+  return std::string(home ? home : "/tmp") + "/.local/share/boomer2/archive";
+}
+
+tile_archive::tile_archive(std::string root) noexcept : _root(std::move(root)) {
+  if (!make_dirs(_root + "/manifests")) return;
+
+  _pack = open((_root + "/tiles.pack").c_str(), O_CREAT | O_RDWR, 0644);
+  _idx = open((_root + "/tiles.idx").c_str(), O_CREAT | O_RDWR, 0644);
+  if (!ok()) return;
+
+  file_lock reader(_idx, LOCK_SH);
+  _sync();
+
+  LOG("Archive %s: %zu tiles, %zu pack bytes\n", _root.c_str(), _index.size(), (size_t)_pack_bytes);
+}
+
+// Under the file lock: sizes of both files, and the records appended since the last call,
+// by this or another process
+bool tile_archive::_sync() noexcept {
+  struct stat pack, idx;
+  if (fstat(_pack, &pack) || fstat(_idx, &idx)) return false;
+
+  // Partial record from a torn append is overwritten by the next one
+  const uint64_t idx_bytes = idx.st_size / sizeof(index_record) * sizeof(index_record);
+
+  if (idx_bytes > _idx_bytes) {
+    std::vector<index_record> records((idx_bytes - _idx_bytes) / sizeof(index_record));
+    if (!read_all(_idx, records.data(), idx_bytes - _idx_bytes, _idx_bytes)) return false;
+
+    // Pack is written before the index, a torn ingest leaves at most unreferenced tile bytes
+    for (auto& r : records)
+      if (r.offset + r.bytes <= (uint64_t)pack.st_size) _index[r.key] = { r.offset, r.bytes, r.raw };
+  }
+
+  _pack_bytes = pack.st_size;
+  _idx_bytes = idx_bytes;
+  return true;
+}
+
+tile_archive::~tile_archive() noexcept {
+  if (_pack >= 0) close(_pack);
+  if (_idx >= 0) close(_idx);
+}
+
+tile_archive::ingest_result tile_archive::ingest(const u_char* pixels, uint width, uint height) noexcept {
+  auto start = std::chrono::steady_clock::now();
+  ingest_result result = {};
+
+  if (!ok() || !width || !height) return result;
+
+  tile_grid grid(width, height, BPP);
+  const size_t count = (size_t)grid.cols * grid.rows;
+  std::vector<uint64_t> keys(count);
+
+  jobs().parallel_for(0, count, 32, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) keys[t] = tile_key(pixels, width, grid.rect(t % grid.cols, t / grid.cols));
+  });
+
+  // Tiles not in the store yet, first occurrence only. Compression runs without the lock,
+  // the job system may run another ingest on this thread meanwhile.
+  std::vector<size_t> fresh;
+  {
+    std::lock_guard lock(_mutex);
+    std::unordered_map<uint64_t, size_t> seen;
+
+    for (size_t t = 0; t < count; t++)
+      if (!_index.contains(keys[t]) && seen.emplace(keys[t], t).second) fresh.push_back(t);
+  }
+
+  std::vector<std::vector<u_char>> packed(fresh.size());
+
+  jobs().parallel_for(0, fresh.size(), 8, [&](size_t begin, size_t end) {
+    std::vector<u_char> tile(TILE_SIZE * TILE_SIZE * BPP);
+
+    for (size_t i = begin; i < end; i++) {
+      auto r = grid.rect(fresh[i] % grid.cols, fresh[i] / grid.cols);
+      size_t bytes = (size_t)r.width * r.height * BPP;
+
+      pack_rect(pixels, width, BPP, r, tile.data());
+      packed[i].resize(lz_bound(bytes));
+      packed[i].resize(lz_compress(tile.data(), bytes, packed[i].data()));
+    }
+  });
+
+  {
+    std::lock_guard lock(_mutex);
+    file_lock writer(_idx, LOCK_EX);
+    if (writer.fd < 0 || !_sync()) return result;
+
+    for (size_t i = 0; i < fresh.size(); i++) {
+      auto key = keys[fresh[i]];
+      if (_index.contains(key)) continue;
+
+      auto r = grid.rect(fresh[i] % grid.cols, fresh[i] / grid.cols);
+      index_record record = { key, _pack_bytes, (uint32_t)packed[i].size(), r.width * r.height * BPP };
+
+      if (!write_all(_pack, packed[i].data(), record.bytes, record.offset)) return result;
+      if (!write_all(_idx, &record, sizeof(record), _idx_bytes)) return result;
+
+      _index[key] = { record.offset, record.bytes, record.raw };
+      _pack_bytes += record.bytes;
+      _idx_bytes += sizeof(record);
+
+      result.new_tiles++;
+      result.stored_bytes += record.bytes;
+    }
+  }
+
+  // Local time, counter only when two exports land in the same millisecond
+  auto now = std::chrono::system_clock::now();
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+  time_t t = std::chrono::system_clock::to_time_t(now);
+
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&t));
+
+  int fd = -1;
+  std::string name;
+
+  for (uint n = 0; fd < 0 && n < 100; n++) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), n ? "%s-%03lld-%u" : "%s-%03lld", stamp, (long long)ms, n);
+
+    name = buffer;
+    fd = open((_root + "/manifests/" + name).c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (fd < 0 && errno != EEXIST) break;
+  }
+
+  if (fd < 0) return result;
+
+  manifest_header header = {};
+  memcpy(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+  header.width = width;
+  header.height = height;
+  header.tiles = count;
+
+  bool written = write_all(fd, &header, sizeof(header), 0)
+    && write_all(fd, keys.data(), count * sizeof(uint64_t), sizeof(header));
+  close(fd);
+
+  if (!written) {
+    unlink((_root + "/manifests/" + name).c_str());
+    return result;
+  }
+
+  result.name = name;
+  result.tiles = count;
+  result.raw_bytes = (size_t)width * height * BPP;
+  result.took_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  LOG("Archived %s: %zu of %zu tiles new, %zu bytes\n", name.c_str(), result.new_tiles, count, result.stored_bytes);
+  return result;
+}
+
+static bool read_manifest(const std::string& path, manifest_header* header, std::vector<uint64_t>* keys) noexcept {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  bool ok = read_all(fd, header, sizeof(*header), 0)
+    && !memcmp(header->magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC))
+    && header->tiles == (uint64_t)((header->width + TILE_SIZE - 1) / TILE_SIZE) * ((header->height + TILE_SIZE - 1) / TILE_SIZE);
+
+  if (ok && keys) {
+    keys->resize(header->tiles);
+    ok = read_all(fd, keys->data(), header->tiles * sizeof(uint64_t), sizeof(*header));
+  }
+
+  close(fd);
+  return ok;
+}
+
+u_char* tile_archive::restore(const std::string& name, uint* width, uint* height) noexcept {
+  if (!ok() || name.find('/') != std::string::npos) return nullptr;
+
+  manifest_header header;
+  std::vector<uint64_t> keys;
+  if (!read_manifest(_root + "/manifests/" + name, &header, &keys)) return nullptr;
+
+  std::vector<location> locations(keys.size());
+  {
+    std::lock_guard lock(_mutex);
+
+    // Image may have been archived by another process since
+    if (std::any_of(keys.begin(), keys.end(), [&](uint64_t key) { return !_index.contains(key); })) {
+      file_lock reader(_idx, LOCK_SH);
+      _sync();
+    }
+
+    for (size_t t = 0; t < keys.size(); t++) {
+      auto it = _index.find(keys[t]);
+      if (it == _index.end()) return nullptr;
+      locations[t] = it->second;
+    }
+  }
+
+  tile_grid grid(header.width, header.height, BPP);
+  u_char* pixels = capture_buffers().acquire((size_t)header.width * header.height * BPP);
+  if (!pixels) return nullptr;
+
+  std::atomic<bool> restored = true;
+
+  jobs().parallel_for(0, keys.size(), 16, [&](size_t begin, size_t end) {
+    std::vector<u_char> compressed, tile(TILE_SIZE * TILE_SIZE * BPP);
+
+    for (size_t t = begin; t < end; t++) {
+      auto r = grid.rect(t % grid.cols, t / grid.cols);
+      auto& l = locations[t];
+
+      compressed.resize(l.bytes);
+      if (l.raw != r.width * r.height * BPP
+          || !read_all(_pack, compressed.data(), l.bytes, l.offset)
+          || !lz_decompress(compressed.data(), l.bytes, tile.data(), l.raw)) {
+        restored = false;
+        continue;
+      }
+
+      for (uint y = 0; y < r.height; y++)
+        memcpy(pixels + ((size_t)(r.y + y) * header.width + r.x) * BPP, tile.data() + (size_t)y * r.width * BPP, (size_t)r.width * BPP);
+    }
+  });
+
+  if (!restored) {
+    capture_buffers().release(pixels);
+    return nullptr;
+  }
+
+  *width = header.width;
+  *height = header.height;
+  return pixels;
+}
+
+std::vector<tile_archive::entry> tile_archive::list() noexcept {
+  std::vector<entry> entries;
+
+  DIR* dir = opendir((_root + "/manifests").c_str());
+  if (!dir) return entries;
+
+  while (auto* e = readdir(dir)) {
+    if (e->d_name[0] == '.') continue;
+
+    manifest_header header;
+    if (read_manifest(_root + "/manifests/" + e->d_name, &header, nullptr))
+      entries.push_back({ e->d_name, header.width, header.height, header.tiles });
+  }
+
+  closedir(dir);
+
+  std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.name < b.name; });
+  return entries;
+}
+
+size_t tile_archive::unique_tiles() noexcept {
+  std::lock_guard lock(_mutex);
+  return _index.size();
+}
+
+size_t tile_archive::disk_bytes() noexcept {
+  size_t total = file_bytes(_root + "/tiles.pack") + file_bytes(_root + "/tiles.idx");
+
+  for (auto& e : list()) total += file_bytes(_root + "/manifests/" + e.name);
+  return total;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Content addressed store of exported images. Every image is cut into TILE_SIZE
+// tiles keyed by their hash_tile, each unique tile is LZ compressed and stored
+// once, a manifest per image lists the keys of its tiles in row order.
+//   <root>/tiles.pack         compressed tiles back to back, append only
+//   <root>/tiles.idx          key, offset and size per stored tile, append only
+//   <root>/manifests/<name>   image size and tile keys
+// Safe to ingest from several export workers and several processes at once, appends
+// hold an flock on tiles.idx.
+class tile_archive {
+  struct location {
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t raw;
+  };
+
+  std::string _root;
+  std::mutex _mutex;
+  std::unordered_map<uint64_t, location> _index;
+  int _pack = -1;
+  int _idx = -1;
+  uint64_t _pack_bytes = 0;
+  uint64_t _idx_bytes = 0;
+
+  bool _sync() noexcept;
+
+public:
+  struct ingest_result {
+    std::string name;
+    size_t tiles, new_tiles;
+    size_t raw_bytes, stored_bytes;
+    double took_ms;
+  };
+
+  struct entry {
+    std::string name;
+    uint width, height;
+    size_t tiles;
+  };
+
+  explicit tile_archive(std::string root) noexcept;
+  ~tile_archive() noexcept;
+
+  tile_archive(const tile_archive&) = delete;
+  tile_archive& operator=(const tile_archive&) = delete;
+
+  inline bool ok() const noexcept { return _pack >= 0 && _idx >= 0; }
+
+  // RGBA8 pixels, name is derived from current time. Empty name on failure.
+  ingest_result ingest(const u_char* pixels, uint width, uint height) noexcept;
+
+  // Capture buffer (see buffers.h) with the image, nullptr when name is unknown or damaged
+  u_char* restore(const std::string& name, uint* width, uint* height) noexcept;
+
+  // Manifests sorted by name, that is oldest first
+  std::vector<entry> list() noexcept;
+
+  size_t unique_tiles() noexcept;
+  size_t disk_bytes() noexcept;
+};
+
+// $BOOMER2_ARCHIVE_DIR, $XDG_DATA_HOME/boomer2/archive or ~/.local/share/boomer2/archive
+std::string default_archive_dir() noexcept;
@@ -0,0 +1,222 @@
+#include "batch.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <optional>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+static inline double now_ms() noexcept {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool load_batch(const char* path, std::vector<batch_job>* jobs, std::string* error) noexcept {
+  FILE* in = fopen(path, "r");
+  if (!in) {
+    *error = std::string("can't open ") + path;
+    return false;
+  }
+
+  batch_job common;
+  batch_job* current = &common;
+
+  char* line = nullptr;
+  size_t capacity = 0;
+  uint number = 0;
+  bool ok = true;
+
+  while (ok && getline(&line, &capacity, in) >= 0) {
+    number++;
+
+    if (char* comment = strchr(line, '#')) *comment = 0;
+    line[strcspn(line, "\r\n")] = 0;
+
+    char word[16] = {};
+    int used = 0;
+    if (sscanf(line, " %15s %n", word, &used) < 1) continue;
+
+    const char* rest = line + used;
+    batch_shape s;
+    char input[4096], output[4096];
+
+    auto shape = [&]() { return sscanf(rest, "%f %f %f %f", &s.x0, &s.y0, &s.x1, &s.y1) == 4; };
+
+    if (!strcmp(word, "image") && sscanf(rest, "%4095s %4095s", input, output) == 2) {
+      jobs->push_back(common);
+      current = &jobs->back();
+      current->input = input;
+      current->output = output;
+    }
+    else if (!strcmp(word, "crosshair") && sscanf(rest, "%f %f", &s.x0, &s.y0) == 2) current->crosshairs.push_back({ s.x0, s.y0 });
+    else if (!strcmp(word, "line") && shape()) current->lines.push_back(s);
+    else if (!strcmp(word, "arrow") && shape()) current->arrows.push_back(s);
+    else if (!strcmp(word, "rectangle") && shape()) current->rectangles.push_back(s);
+    else if (!strcmp(word, "text")) {
+      batch_text t;
+      int text_at = 0;
+
+      if (sscanf(rest, "%f %f %f %n", &t.x, &t.y, &t.size, &text_at) < 3 || !rest[text_at]) ok = false;
+      else {
+        t.text = rest + text_at;
+        current->texts.push_back(std::move(t));
+      }
+    }
+    else ok = false;
+  }
+
+  free(line);
+  fclose(in);
+
+  if (!ok) *error = std::string(path) + ":" + std::to_string(number) + ": can't parse";
+  else if (jobs->empty()) *error = std::string(path) + ": no images";
+
+  return ok && !jobs->empty();
+}
+
+void batch_stats::report(FILE* out) const noexcept {
+  const double n = std::max<size_t>(images + failed, 1);
+
+  fprintf(out, "batch: %zu images (%zu failed) in %.2fs, %.1f images/s\n", images, failed, seconds, images / std::max(seconds, 1e-9));
+  fprintf(out, "per image: decode %.2fms, render %.2fms, readback %.2fms, encode %.2fms\n",
+    decode_ms / n, render_ms / n, readback_ms / n, encode_ms / n);
+}
+
+batch_stats run_batch(
+  const std::vector<batch_job>& batch, uint depth,
+  const std::function<const RenderTexture2D*(const batch_job&, const Image&)>& render
+) noexcept {
+  const double start = now_ms();
+  const size_t n = batch.size();
+  depth = std::max(depth, 1u);
+
+  batch_stats stats;
+
+  struct decoded { Image image = {}; double ms = 0; };
+  struct encoded { bool ok = false; double ms = 0; };
+
+  std::vector<decoded> images(n);
+  std::vector<encoded> results(n);
+  std::vector<job_handle> decodes(n);
+  std::deque<job_handle> encodes;
+
+  auto decode = [&](size_t i) {
+    decodes[i] = jobs().submit([&, i]() {
+      auto t = now_ms();
+      Image image = LoadImage(batch[i].input.c_str());
+      if (image.data) ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+      images[i] = { image, now_ms() - t };
+    });
+  };
+
+  // At most depth images wait for their encoder, the oldest one is waited for first
+  auto encode = [&](size_t i, Image image) {
+    if (encodes.size() >= depth) {
+      jobs().wait(encodes.front());
+      encodes.pop_front();
+    }
+
+    encodes.push_back(jobs().submit([&, i, image]() {
+      auto t = now_ms();
+      results[i].ok = ExportImage(image, batch[i].output.c_str());
+      results[i].ms = now_ms() - t;
+      UnloadImage(image);
+    }));
+  };
+
+  GLuint pbo[2];
+  size_t capacity[2] = {};
+  glGenBuffers(2, pbo);
+
+  struct readback { size_t index; uint width, height, buffer; };
+  std::optional<readback> previous;
+  uint issued = 0;
+
+  auto collect = [&](const readback& r) {
+    auto t = now_ms();
+    const size_t bytes = (size_t)r.width * r.height * 4;
+
+    Image image = {
+      .data = MemAlloc(bytes),
+      .width = (int)r.width,
+      .height = (int)r.height,
+      .mipmaps = 1,
+      .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[r.buffer]);
+    auto* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (mapped) {
+      memcpy(image.data, mapped, bytes);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    stats.readback_ms += now_ms() - t;
+
+    if (mapped) encode(r.index, image);
+    else UnloadImage(image);
+  };
+
+  for (size_t i = 0; i < std::min<size_t>(depth, n); i++) decode(i);
+
+  for (size_t i = 0; i < n; i++) {
+    jobs().wait(decodes[i]);
+    if (i + depth < n) decode(i + depth);
+
+    stats.decode_ms += images[i].ms;
+
+    if (!images[i].image.data) {
+      fprintf(stderr, "batch: can't load %s\n", batch[i].input.c_str());
+      continue;
+    }
+
+    auto t = now_ms();
+    const RenderTexture2D* target = render(batch[i], images[i].image);
+    UnloadImage(images[i].image);
+    stats.render_ms += now_ms() - t;
+
+    if (!target) continue;
+
+    // The target is drawn over by the next image only after this read is queued
+    t = now_ms();
+    readback r = { i, (uint)target->texture.width, (uint)target->texture.height, issued++ % 2 };
+    const size_t bytes = (size_t)r.width * r.height * 4;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target->id);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[r.buffer]);
+
+    if (capacity[r.buffer] < bytes) {
+      glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+      capacity[r.buffer] = bytes;
+    }
+
+    glReadPixels(0, 0, r.width, r.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    stats.readback_ms += now_ms() - t;
+
+    if (previous) collect(*previous);
+    previous = r;
+  }
+
+  if (previous) collect(*previous);
+  for (auto& e : encodes) jobs().wait(e);
+
+  glDeleteBuffers(2, pbo);
+
+  for (size_t i = 0; i < n; i++) {
+    if (results[i].ok) stats.images++;
+    else stats.failed++;
+    stats.encode_ms += results[i].ms;
+  }
+
+  stats.seconds = (now_ms() - start) / 1000;
+  return stats;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <raylib.h>
+#include <sys/types.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Job file of --batch, one directive per line, '#' starts a comment. Coordinates are
+// image pixels. Annotations before the first image go on every image, the ones after
+// an image line only on that image.
+//   image <in> <out>
+//   crosshair <x> <y>
+//   line <x0> <y0> <x1> <y1>
+//   arrow <x0> <y0> <x1> <y1>
+//   rectangle <x0> <y0> <x1> <y1>
+//   text <x> <y> <size> <text to the end of line>
+struct batch_shape {
+  float x0, y0, x1, y1;
+};
+
+struct batch_text {
+  float x, y, size;
+  std::string text;
+};
+
+struct batch_job {
+  std::string input, output;
+
+  std::vector<Vector2> crosshairs = {};
+  std::vector<batch_shape> lines = {};
+  std::vector<batch_shape> arrows = {};
+  std::vector<batch_shape> rectangles = {};
+  std::vector<batch_text> texts = {};
+};
+
+// Jobs with the common annotations merged in, false with a message naming the line
+bool load_batch(const char* path, std::vector<batch_job>* jobs, std::string* error) noexcept;
+
+struct batch_stats {
+  size_t images = 0, failed = 0;
+  double seconds = 0;
+
+  // Summed over images, decode and encode run on several workers at once
+  double decode_ms = 0, render_ms = 0, readback_ms = 0, encode_ms = 0;
+
+  void report(FILE* out) const noexcept;
+};
+
+// decode -> render -> readback -> encode. Decoding runs `depth` images ahead as jobs,
+// render is called on this (GL) thread with the decoded RGBA8 image and returns the
+// target it drew into. Readback goes through two pixel buffers, so the previous
+// image is mapped while the GPU works on this one, and encoding is a job again.
+batch_stats run_batch(
+  const std::vector<batch_job>& batch, uint depth,
+  const std::function<const RenderTexture2D*(const batch_job&, const Image&)>& render
+) noexcept;
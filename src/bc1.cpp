@@ -0,0 +1,164 @@
+#include "bc1.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __AVX2__
+  #include <immintrin.h>
+#endif
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+static inline uint16_t to_565(const int c[3]) noexcept {
+  return ((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255);
+}
+
+static inline void from_565(uint16_t v, int c[3]) noexcept {
+  int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+  c[0] = r << 3 | r >> 2;
+  c[1] = g << 2 | g >> 4;
+  c[2] = b << 3 | b >> 2;
+}
+
+// Position along the axis from colour1 (0) to colour0 (3) onto BC1 palette index
+static constexpr uint32_t INDEX_OF_STEP[4] = { 1, 3, 2, 0 };
+
+static void encode_block(const u_char* src, size_t stride, u_char* out) noexcept {
+  int lo[3], hi[3];
+
+#ifdef __AVX2__
+  __m128i rows[4];
+  for (uint y = 0; y < 4; y++) rows[y] = _mm_loadu_si128((const __m128i*)(src + y * stride));
+
+  __m128i mn = _mm_min_epu8(_mm_min_epu8(rows[0], rows[1]), _mm_min_epu8(rows[2], rows[3]));
+  __m128i mx = _mm_max_epu8(_mm_max_epu8(rows[0], rows[1]), _mm_max_epu8(rows[2], rows[3]));
+
+  // Four pixels of a row down to one
+  mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+  mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+  mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+  mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+
+  uint32_t min_px = _mm_cvtsi128_si32(mn), max_px = _mm_cvtsi128_si32(mx);
+  for (uint ch = 0; ch < 3; ch++) {
+    lo[ch] = (min_px >> (ch * 8)) & 0xFF;
+    hi[ch] = (max_px >> (ch * 8)) & 0xFF;
+  }
+#else
+  for (uint ch = 0; ch < 3; ch++) { lo[ch] = 255; hi[ch] = 0; }
+
+  for (uint y = 0; y < 4; y++)
+    for (uint x = 0; x < 4; x++)
+      for (uint ch = 0; ch < 3; ch++) {
+        int v = src[y * stride + x * 4 + ch];
+        lo[ch] = std::min(lo[ch], v);
+        hi[ch] = std::max(hi[ch], v);
+      }
+#endif
+
+  // Inset by 1/16 of the range, the extremes are rarely worth a palette entry
+  for (uint ch = 0; ch < 3; ch++) {
+    int inset = (hi[ch] - lo[ch]) >> 4;
+    lo[ch] += inset;
+    hi[ch] -= inset;
+  }
+
+  uint16_t c0 = to_565(hi), c1 = to_565(lo);
+  uint32_t indices = 0;
+
+  // Packing is monotonic per channel so c0 >= c1, equal is a solid block
+  if (c0 != c1) {
+    int e0[3], e1[3], axis[3];
+    from_565(c0, e0);
+    from_565(c1, e1);
+    for (uint ch = 0; ch < 3; ch++) axis[ch] = e0[ch] - e1[ch];
+
+    const float scale = 3.0f / (axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+#ifdef __AVX2__
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i vaxis = _mm_setr_epi16(axis[0], axis[1], axis[2], 0, axis[0], axis[1], axis[2], 0);
+    const __m128i vbase = _mm_setr_epi16(e1[0], e1[1], e1[2], 0, e1[0], e1[1], e1[2], 0);
+    const __m128  vscale = _mm_set1_ps(scale);
+    const __m128i three = _mm_set1_epi32(3);
+
+    for (uint y = 0; y < 4; y++) {
+      // (p - e1) . axis, two pixels per madd, pairs summed by hadd
+      __m128i a = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(rows[y], zero), vbase), vaxis);
+      __m128i b = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(rows[y], zero), vbase), vaxis);
+      __m128i dots = _mm_hadd_epi32(a, b);
+
+      __m128i steps = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(dots), vscale));
+      steps = _mm_min_epi32(_mm_max_epi32(steps, zero), three);
+
+      alignas(16) int32_t s[4];
+      _mm_store_si128((__m128i*)s, steps);
+      for (uint x = 0; x < 4; x++) indices |= INDEX_OF_STEP[s[x]] << ((y * 4 + x) * 2);
+    }
+#else
+    for (uint y = 0; y < 4; y++)
+      for (uint x = 0; x < 4; x++) {
+        const u_char* p = src + y * stride + x * 4;
+        int dot = (p[0] - e1[0]) * axis[0] + (p[1] - e1[1]) * axis[1] + (p[2] - e1[2]) * axis[2];
+        int step = std::clamp((int)std::nearbyint(dot * scale), 0, 3);
+        indices |= INDEX_OF_STEP[step] << ((y * 4 + x) * 2);
+      }
+#endif
+  }
+
+  memcpy(out + 0, &c0, 2);
+  memcpy(out + 2, &c1, 2);
+  memcpy(out + 4, &indices, 4);
+}
+
+void bc1_compress(const u_char* pixels, uint width, uint height, u_char* out) noexcept {
+  const uint cols = (width + BC1_BLOCK - 1) / BC1_BLOCK, rows = (height + BC1_BLOCK - 1) / BC1_BLOCK;
+  const size_t stride = (size_t)width * 4;
+
+  jobs().parallel_for(0, rows, 8, [&](size_t begin, size_t end) {
+    u_char edge[BC1_BLOCK * BC1_BLOCK * 4];
+
+    for (size_t by = begin; by < end; by++)
+      for (uint bx = 0; bx < cols; bx++) {
+        const uint x0 = bx * BC1_BLOCK, y0 = by * BC1_BLOCK;
+        u_char* block = out + (by * cols + bx) * 8;
+
+        if (x0 + BC1_BLOCK <= width && y0 + BC1_BLOCK <= height) {
+          encode_block(pixels + y0 * stride + x0 * 4, stride, block);
+          continue;
+        }
+
+        for (uint y = 0; y < BC1_BLOCK; y++)
+          for (uint x = 0; x < BC1_BLOCK; x++)
+            memcpy(edge + (y * BC1_BLOCK + x) * 4, pixels + std::min(y0 + y, height - 1) * stride + std::min(x0 + x, width - 1) * 4, 4);
+
+        encode_block(edge, BC1_BLOCK * 4, block);
+      }
+  });
+}
+
+uint bc1_upload(const u_char* blocks, uint width, uint height) noexcept {
+  while (glGetError() != GL_NO_ERROR) {}
+
+  GLuint id = 0;
+  glGenTextures(1, &id);
+  glBindTexture(GL_TEXTURE_2D, id);
+  glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height, 0, bc1_bytes(width, height), blocks);
+
+  // What raylib sets on the textures it loads
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (glGetError() == GL_NO_ERROR) return id;
+
+  glDeleteTextures(1, &id);
+  return 0;
+}
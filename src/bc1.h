@@ -0,0 +1,22 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+
+// BC1 (DXT1) blocks of RGBA8 pixels, alpha is dropped: 8 bytes per 4x4 block, an eighth
+// of RGBA8. Endpoints are the inset bounding box of a block's colours, every pixel takes
+// the palette entry nearest to its projection onto the axis between them. Good enough
+// for looking at a capture, exports keep using the lossless pixels.
+constexpr uint BC1_BLOCK = 4;
+
+inline size_t bc1_bytes(uint width, uint height)
+noexcept { return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8; }
+
+// Rows of blocks in parallel, out holds bc1_bytes(). Partial blocks at the right and
+// bottom edges are filled up by repeating the last column and row.
+void bc1_compress(const u_char* pixels, uint width, uint height, u_char* out) noexcept;
+
+// GL texture of bc1_compress() output, 0 when the driver refuses it. raylib sizes DXT1
+// data as width * height / 2, short of the partial blocks, so this goes to GL directly.
+uint bc1_upload(const u_char* blocks, uint width, uint height) noexcept;
@@ -0,0 +1,169 @@
+#include "buffers.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static constexpr size_t HUGE_PAGE = 2 << 20;
+
+capture_pool& capture_buffers() noexcept {
+  static capture_pool instance;
+  return instance;
+}
+
+capture_pool::~capture_pool() noexcept {
+  trim();
+  for (auto& [p, b] : _live) _unmap(p, b);
+}
+
+void capture_pool::_unmap(u_char* p, const block& b) noexcept {
+  munmap(p, b.kind == backing::HUGETLB ? (b.size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE : b.size);
+}
+
+u_char* capture_pool::acquire(size_t bytes) noexcept {
+  {
+    std::lock_guard lock(_mutex);
+
+    auto it = std::find_if(_cached.begin(), _cached.end(), [&](auto& c) { return c.second.size == bytes; });
+    if (it != _cached.end()) {
+      auto [p, b] = *it;
+      _cached.erase(it);
+
+      _live[p] = b;
+      _live_bytes += bytes;
+      _peak_bytes = std::max(_peak_bytes, _live_bytes);
+      return p;
+    }
+  }
+
+  block b = { bytes, backing::HUGETLB };
+
+  void* p = mmap(nullptr, (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+  if (p == MAP_FAILED) {
+    // No reserved huge pages, ask for transparent ones
+    b.kind = backing::ANON;
+    p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+
+    madvise(p, bytes, MADV_HUGEPAGE);
+  }
+
+  std::lock_guard lock(_mutex);
+  _live[(u_char*)p] = b;
+  _live_bytes += bytes;
+  _peak_bytes = std::max(_peak_bytes, _live_bytes);
+
+  return (u_char*)p;
+}
+
+void capture_pool::release(u_char* p) noexcept {
+  if (!p) return;
+
+  std::lock_guard lock(_mutex);
+
+  auto it = _live.find(p);
+  if (it == _live.end()) return;
+
+  auto b = it->second;
+  _live.erase(it);
+  _live_bytes -= b.size;
+
+  if (b.kind != backing::FILE && _cached.size() < _cache_limit) {
+    // Keep the address range for the next capture but give pages back right away
+    madvise(p, b.size, MADV_DONTNEED);
+    _cached.push_back({ p, b });
+    return;
+  }
+
+  _unmap(p, b);
+}
+
+u_char* capture_pool::spill(u_char* p) noexcept {
+  size_t size;
+
+  {
+    std::lock_guard lock(_mutex);
+    auto it = _live.find(p);
+    if (it == _live.end() || it->second.kind == backing::FILE) return p;
+    size = it->second.size;
+  }
+
+  const char* dir = getenv("BOOMER2_SPILL_DIR");
+  int fd = open(dir ? dir : "/var/tmp", O_TMPFILE | O_RDWR, 0600);
+  if (fd < 0) return p;
+
+  size_t written = 0;
+  while (written < size) {
+    auto n = write(fd, p + written, size - written);
+    if (n <= 0) { close(fd); return p; }
+    written += n;
+  }
+
+  void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mapped == MAP_FAILED) return p;
+
+  // Clean pages are written back already, drop them until someone reads them
+  madvise(mapped, size, MADV_DONTNEED);
+
+  release(p);
+
+  std::lock_guard lock(_mutex);
+  _live[(u_char*)mapped] = { size, backing::FILE };
+  _live_bytes += size;
+
+  return (u_char*)mapped;
+}
+
+u_char* capture_pool::map_file(int fd, size_t offset, size_t bytes) noexcept {
+  void* mapped = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, offset);
+  if (mapped == MAP_FAILED) return nullptr;
+
+  std::lock_guard lock(_mutex);
+  _live[(u_char*)mapped] = { bytes, backing::FILE };
+  _live_bytes += bytes;
+  _peak_bytes = std::max(_peak_bytes, _live_bytes);
+
+  return (u_char*)mapped;
+}
+
+void capture_pool::trim() noexcept {
+  std::lock_guard lock(_mutex);
+  for (auto& [p, b] : _cached) _unmap(p, b);
+  _cached.clear();
+}
+
+size_t capture_pool::live_bytes() noexcept {
+  std::lock_guard lock(_mutex);
+  return _live_bytes;
+}
+
+size_t capture_pool::peak_bytes() noexcept {
+  std::lock_guard lock(_mutex);
+  return _peak_bytes;
+}
+
+size_t current_rss_kb() noexcept {
+  long pages = 0, resident = 0;
+
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (!f) return 0;
+
+  if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(f);
+
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+size_t peak_rss_kb() noexcept {
+  rusage usage = {};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
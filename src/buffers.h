@@ -0,0 +1,58 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Large page-aligned (so at least 64 byte aligned) buffers for captures.
+// Tries MAP_HUGETLB first, falls back to anonymous memory with THP advice.
+// Released buffers are cached and handed out again for the next capture of
+// the same size (recapture, daemon sessions).
+class capture_pool {
+  enum class backing { HUGETLB, ANON, FILE };
+
+  struct block {
+    size_t size;
+    backing kind;
+  };
+
+  std::mutex _mutex;
+  std::unordered_map<u_char*, block> _live;
+  std::vector<std::pair<u_char*, block>> _cached;
+
+  size_t _live_bytes = 0;
+  size_t _peak_bytes = 0;
+  size_t _cache_limit;
+
+  static void _unmap(u_char* p, const block& b) noexcept;
+
+public:
+  explicit capture_pool(size_t cache_limit = 2) noexcept : _cache_limit(cache_limit) {}
+  ~capture_pool() noexcept;
+
+  u_char* acquire(size_t bytes) noexcept;
+  void release(u_char* p) noexcept;
+
+  // Moves pixels into an unlinked file mapping. Page cache can evict it under
+  // pressure instead of keeping anonymous memory resident. Returns the new
+  // (read-only) address, p itself on failure.
+  u_char* spill(u_char* p) noexcept;
+
+  // Read-only private mapping of bytes at a page aligned offset of fd, released like
+  // any other buffer. Pages are populated up front, the caller reads all of them.
+  u_char* map_file(int fd, size_t offset, size_t bytes) noexcept;
+
+  void trim() noexcept;
+
+  size_t live_bytes() noexcept;
+  size_t peak_bytes() noexcept;
+};
+
+capture_pool& capture_buffers() noexcept;
+
+// Resident and peak resident set of the process in KiB.
+size_t current_rss_kb() noexcept;
+size_t peak_rss_kb() noexcept;
@@ -0,0 +1,177 @@
+#include "diff.h"
+#include "buffers.h"
+#include "jobs.h"
+
+#include <raylib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __AVX2__
+  #include <immintrin.h>
+#endif
+
+size_t diff_row(const u_char* a, const u_char* b, u_char* mask, size_t pixels, u_char threshold) noexcept {
+  size_t i = 0, changed = 0;
+
+#ifdef __AVX2__
+  const __m256i thr  = _mm256_set1_epi8(threshold);
+  const __m256i rgb  = _mm256_set1_epi32(0x00FFFFFF);
+  const __m256i zero = _mm256_setzero_si256();
+
+  for (; i + 8 <= pixels; i += 8) {
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a + i * 4));
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i * 4));
+
+    // |a - b| per byte, anything left after subtracting threshold is a change
+    __m256i absdiff = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+    __m256i over    = _mm256_and_si256(_mm256_subs_epu8(absdiff, thr), rgb);
+    __m256i same    = _mm256_cmpeq_epi32(over, zero);
+
+    // 8 x int32 (0 / -1) -> 8 bytes
+    __m256i p16 = _mm256_packs_epi32(same, same);
+    __m256i p8  = _mm256_packs_epi16(p16, p16);
+
+    uint32_t lo = ~(uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(p8));
+    uint32_t hi = ~(uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(p8, 1));
+
+    memcpy(mask + i, &lo, 4);
+    memcpy(mask + i + 4, &hi, 4);
+
+    changed += (8 - __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(same))));
+  }
+#endif
+
+  for (; i < pixels; i++) {
+    bool c = false;
+    for (uint ch = 0; ch < 3; ch++) c |= std::abs(a[i * 4 + ch] - b[i * 4 + ch]) > threshold;
+
+    mask[i] = c ? 255 : 0;
+    changed += c;
+  }
+
+  return changed;
+}
+
+static_assert(DIFF_CELL == 16, "group_cells reads a cell row as two words");
+
+static std::vector<tile_rect> group_cells(const std::vector<u_char>& mask, uint width, uint height) noexcept {
+  const uint cols = (width + DIFF_CELL - 1) / DIFF_CELL;
+  const uint rows = (height + DIFF_CELL - 1) / DIFF_CELL;
+
+  std::vector<u_char> cells((size_t)cols * rows, 0);
+
+  jobs().parallel_for(0, rows, 4, [&](size_t begin, size_t end) {
+    for (size_t cy = begin; cy < end; cy++)
+      for (uint y = cy * DIFF_CELL; y < std::min<uint>((cy + 1) * DIFF_CELL, height); y++) {
+        const u_char* row = mask.data() + (size_t)y * width;
+
+        // One cell row is 16 mask bytes, two word loads
+        for (uint cx = 0; cx < cols; cx++) {
+          auto& cell = cells[cy * cols + cx];
+          if (cell) continue;
+
+          uint x = cx * DIFF_CELL;
+
+          if (x + DIFF_CELL <= width) {
+            uint64_t lo, hi;
+            memcpy(&lo, row + x, 8);
+            memcpy(&hi, row + x + 8, 8);
+            if (lo | hi) cell = 255;
+          } else {
+            for (; x < width; x++) cell |= row[x];
+          }
+        }
+      }
+  });
+
+  std::vector<tile_rect> boxes;
+  std::vector<uint> stack;
+
+  // Flood fill over changed cells, a box is the extent of one component
+  for (uint start = 0; start < cells.size(); start++) {
+    if (cells[start] != 255) continue;
+
+    uint x0 = cols, y0 = rows, x1 = 0, y1 = 0;
+    cells[start] = 1;
+    stack.push_back(start);
+
+    while (!stack.empty()) {
+      uint c = stack.back();
+      stack.pop_back();
+
+      uint cx = c % cols, cy = c / cols;
+      x0 = std::min(x0, cx); x1 = std::max(x1, cx);
+      y0 = std::min(y0, cy); y1 = std::max(y1, cy);
+
+      for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++) {
+          int nx = cx + dx, ny = cy + dy;
+          if (nx < 0 || ny < 0 || nx >= (int)cols || ny >= (int)rows) continue;
+
+          auto& n = cells[(size_t)ny * cols + nx];
+          if (n != 255) continue;
+
+          n = 1;
+          stack.push_back(ny * cols + nx);
+        }
+    }
+
+    uint px = x0 * DIFF_CELL, py = y0 * DIFF_CELL;
+    boxes.push_back({ px, py, std::min((x1 + 1) * DIFF_CELL, width) - px, std::min((y1 + 1) * DIFF_CELL, height) - py });
+  }
+
+  return boxes;
+}
+
+diff_result diff_frames(
+  const u_char* base, uint base_width, uint base_height,
+  const u_char* next, uint width, uint height,
+  u_char threshold
+) noexcept {
+  auto start = std::chrono::steady_clock::now();
+
+  diff_result r;
+  r.width = width;
+  r.height = height;
+  r.mask.assign((size_t)width * height, 0);
+
+  const uint w = std::min(width, base_width);
+  const uint h = std::min(height, base_height);
+
+  std::atomic<size_t> changed = 0;
+
+  jobs().parallel_for(0, h, 32, [&](size_t begin, size_t end) {
+    size_t local = 0;
+
+    for (size_t y = begin; y < end; y++)
+      local += diff_row(base + y * base_width * 4, next + y * width * 4, r.mask.data() + y * width, w, threshold);
+
+    changed += local;
+  });
+
+  r.changed = changed;
+  r.boxes = group_cells(r.mask, width, height);
+  r.took_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  return r;
+}
+
+u_char* load_rgba_file(const char* path, std::pair<uint, uint>* size) noexcept {
+  Image image = LoadImage(path);
+  if (!image.data) return nullptr;
+
+  ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+  size_t bytes = (size_t)image.width * image.height * 4;
+  u_char* data = capture_buffers().acquire(bytes);
+  if (data) memcpy(data, image.data, bytes);
+
+  *size = { (uint)image.width, (uint)image.height };
+  UnloadImage(image);
+
+  return data;
+}
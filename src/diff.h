@@ -0,0 +1,38 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <utility>
+#include <vector>
+
+#include "tiles.h"
+
+// Changed regions are grouped on a grid of DIFF_CELL x DIFF_CELL cells
+constexpr uint DIFF_CELL = 16;
+
+struct diff_result {
+  uint width = 0, height = 0;
+
+  // One byte per pixel, 255 where any colour channel differs by more than threshold
+  std::vector<u_char> mask = {};
+
+  // 8-connected groups of changed cells, top to bottom, left to right
+  std::vector<tile_rect> boxes = {};
+
+  size_t changed = 0;
+  double took_ms = 0;
+};
+
+// Both frames RGBA8 with tightly packed rows, alpha ignored. Frames of
+// different size are compared over their overlap.
+diff_result diff_frames(
+  const u_char* base, uint base_width, uint base_height,
+  const u_char* next, uint width, uint height,
+  u_char threshold
+) noexcept;
+
+// Per pixel kernel, exposed for benchmarks: writes 255/0 into mask, returns changed count
+size_t diff_row(const u_char* a, const u_char* b, u_char* mask, size_t pixels, u_char threshold) noexcept;
+
+// Decodes an image file into a capture buffer as RGBA8, nullptr on failure
+u_char* load_rgba_file(const char* path, std::pair<uint, uint>* size) noexcept;
@@ -0,0 +1,144 @@
+#include "edges.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __AVX2__
+  #include <immintrin.h>
+#endif
+
+static_assert(TILE_SIZE == 64, "edge masks are one word per tile row");
+
+// Bit i set when pixel a[i] and b[i] differ in any colour channel by more than threshold
+static uint64_t changed_bits(const u_char* a, const u_char* b, uint pixels, u_char threshold) noexcept {
+  uint64_t bits = 0;
+  uint i = 0;
+
+#ifdef __AVX2__
+  const __m256i thr  = _mm256_set1_epi8(threshold);
+  const __m256i rgb  = _mm256_set1_epi32(0x00FFFFFF);
+  const __m256i zero = _mm256_setzero_si256();
+
+  for (; i + 8 <= pixels; i += 8) {
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a + i * 4));
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i * 4));
+
+    __m256i absdiff = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+    __m256i over    = _mm256_and_si256(_mm256_subs_epu8(absdiff, thr), rgb);
+    __m256i same    = _mm256_cmpeq_epi32(over, zero);
+
+    bits |= (uint64_t)(~_mm256_movemask_ps(_mm256_castsi256_ps(same)) & 0xFF) << i;
+  }
+#endif
+
+  for (; i < pixels; i++) {
+    bool c = false;
+    for (uint ch = 0; ch < 3; ch++) c |= std::abs(a[i * 4 + ch] - b[i * 4 + ch]) > threshold;
+    bits |= (uint64_t)c << i;
+  }
+
+  return bits;
+}
+
+// 64x64 bit matrix, a[r] bit c <-> a[c] bit r
+static void transpose64(uint64_t a[64]) noexcept {
+  uint64_t m = 0x00000000FFFFFFFFull;
+
+  for (uint j = 32; j; j >>= 1, m ^= m << j)
+    for (uint k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+      uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+      a[k] ^= t << j;
+      a[k | j] ^= t;
+    }
+}
+
+edge_index::edge_index(uint width, uint height) noexcept
+  : _width(width),
+    _height(height),
+    _cols((width + TILE_SIZE - 1) / TILE_SIZE),
+    _rows((height + TILE_SIZE - 1) / TILE_SIZE),
+    _vertical((size_t)_cols * _rows * TILE_SIZE),
+    _horizontal((size_t)_cols * _rows * TILE_SIZE) {}
+
+void edge_index::_compute_tile(const u_char* pixels, uint col, uint row, u_char threshold) noexcept {
+  const size_t stride = (size_t)_width * 4;
+  const uint x0 = col * TILE_SIZE, y0 = row * TILE_SIZE;
+  const uint w = std::min(TILE_SIZE, _width - x0), h = std::min(TILE_SIZE, _height - y0);
+
+  const size_t tile = (size_t)row * _cols + col;
+  uint64_t* vertical = _vertical.data() + tile * TILE_SIZE;
+  uint64_t* horizontal = _horizontal.data() + tile * TILE_SIZE;
+
+  for (uint r = 0; r < h; r++) {
+    const u_char* p = pixels + (y0 + r) * stride + (size_t)x0 * 4;
+
+    // Left neighbour of the first pixel is in the previous tile, none at the frame edge
+    vertical[r] = x0 ? changed_bits(p - 4, p, w, threshold) : changed_bits(p, p + 4, w - 1, threshold) << 1;
+    horizontal[r] = y0 + r ? changed_bits(p - stride, p, w, threshold) : 0;
+  }
+
+  // Row masks -> column masks
+  transpose64(vertical);
+}
+
+void edge_index::compute(const u_char* pixels, u_char threshold) noexcept {
+  jobs().parallel_for(0, (size_t)_cols * _rows, 8, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) _compute_tile(pixels, t % _cols, t / _cols, threshold);
+  });
+}
+
+// Transitions at boundary `at` over [from, to) along the other axis
+uint edge_index::_strength(const std::vector<uint64_t>& masks, bool vertical, uint at, uint from, uint to) const noexcept {
+  uint count = 0;
+
+  for (uint s = from; s < to;) {
+    uint span_tile = s / TILE_SIZE;
+    uint end = std::min(to, (span_tile + 1) * TILE_SIZE);
+
+    uint64_t span = (end - s == 64 ? ~0ull : ((1ull << (end - s)) - 1)) << (s % TILE_SIZE);
+    size_t tile = vertical
+      ? (size_t)span_tile * _cols + at / TILE_SIZE
+      : (size_t)(at / TILE_SIZE) * _cols + span_tile;
+
+    count += __builtin_popcountll(masks[tile * TILE_SIZE + at % TILE_SIZE] & span);
+    s = end;
+  }
+
+  return count;
+}
+
+uint edge_index::snap_x(uint x, uint y, uint radius, uint reach, uint min_count) const noexcept {
+  if (empty() || y >= _height) return x;
+
+  uint from = y > reach ? y - reach : 0, to = std::min(_height, y + reach);
+  uint best = x, best_count = min_count ? min_count - 1 : 0;
+
+  for (uint d = 0; d <= radius; d++)
+    for (int c : { (int)x - (int)d, (int)x + (int)d }) {
+      if (c < 1 || c >= (int)_width) continue;
+
+      // Closer candidates win ties
+      uint count = _strength(_vertical, true, c, from, to);
+      if (count > best_count) best = c, best_count = count;
+    }
+
+  return best;
+}
+
+uint edge_index::snap_y(uint x, uint y, uint radius, uint reach, uint min_count) const noexcept {
+  if (empty() || x >= _width) return y;
+
+  uint from = x > reach ? x - reach : 0, to = std::min(_width, x + reach);
+  uint best = y, best_count = min_count ? min_count - 1 : 0;
+
+  for (uint d = 0; d <= radius; d++)
+    for (int c : { (int)y - (int)d, (int)y + (int)d }) {
+      if (c < 1 || c >= (int)_height) continue;
+
+      uint count = _strength(_horizontal, false, c, from, to);
+      if (count > best_count) best = c, best_count = count;
+    }
+
+  return best;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "tiles.h"
+
+// Colour transitions of a capture, in TILE_SIZE x TILE_SIZE tiles of 64 bit masks:
+//   vertical[tile][column]  bit per row,    pixel differs from its left neighbour
+//   horizontal[tile][row]   bit per column, pixel differs from the one above
+// so the strength of an edge along a short span is a popcount of one or two words.
+class edge_index {
+  uint _width = 0, _height = 0;
+  uint _cols = 0, _rows = 0;
+
+  std::vector<uint64_t> _vertical = {};
+  std::vector<uint64_t> _horizontal = {};
+
+  void _compute_tile(const u_char* pixels, uint col, uint row, u_char threshold) noexcept;
+  uint _strength(const std::vector<uint64_t>& masks, bool vertical, uint at, uint from, uint to) const noexcept;
+
+public:
+  edge_index() noexcept = default;
+  edge_index(uint width, uint height) noexcept;
+
+  // RGBA8 pixels, a transition is any colour channel changing by more than threshold
+  void compute(const u_char* pixels, u_char threshold = 24) noexcept;
+
+  inline bool empty() const noexcept { return _vertical.empty(); }
+
+  // Boundary within radius of x (or y) with most transitions over [y - reach, y + reach)
+  // (or the same span of columns), x itself when none has at least min_count.
+  uint snap_x(uint x, uint y, uint radius, uint reach, uint min_count) const noexcept;
+  uint snap_y(uint x, uint y, uint radius, uint reach, uint min_count) const noexcept;
+};
@@ -0,0 +1,146 @@
+#include "export.h"
+#include "archive.h"
+#include "handoff.h"
+#include "jobs.h"
+#include "memory.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#ifdef DEBUG
+  static int __COUNTER = -1;
+
+  #define LOG(__format_string, ...) do { \
+    printf("%s:%d (%s)@%d : " __format_string, __FILE__, __LINE__, __FUNCTION__, ++__COUNTER, ##__VA_ARGS__); \
+    fflush(stdout); \
+  } while (0)
+#else
+  #define LOG(__format_string, ...) {}
+#endif
+
+uint default_export_workers() noexcept {
+  auto cores = std::thread::hardware_concurrency();
+  return std::clamp(cores / 2, 1u, 4u);
+}
+
+export_pool::export_pool(uint encoders, size_t capacity, tile_archive* archive, export_handoff* handoff) noexcept
+  : _encoders(std::max(encoders, 1u)), _capacity(capacity), _archive(archive), _handoff(handoff) {}
+
+export_pool::~export_pool() noexcept {
+  std::unique_lock lock(_mutex);
+  _idle_cv.wait(lock, [this]() { return _in_flight == 0; });
+}
+
+bool export_pool::try_submit(Image image, std::string path, bool clipboard) noexcept {
+  {
+    std::lock_guard lock(_mutex);
+    if (_queue.size() >= _capacity) return false;
+
+    _queue.push_back({ image, std::move(path), clipboard, ++_seq });
+    _in_flight++;
+  }
+
+  _pump();
+  return true;
+}
+
+void export_pool::submit(Image image, std::string path, bool clipboard) noexcept {
+  {
+    std::unique_lock lock(_mutex);
+    _idle_cv.wait(lock, [this]() { return _queue.size() < _capacity; });
+
+    _queue.push_back({ image, std::move(path), clipboard, ++_seq });
+    _in_flight++;
+  }
+
+  _pump();
+}
+
+uint export_pool::in_flight() noexcept {
+  std::lock_guard lock(_mutex);
+  return _in_flight;
+}
+
+uint export_pool::submitted() noexcept {
+  std::lock_guard lock(_mutex);
+  return _seq;
+}
+
+void export_pool::_copy_to_clipboard(const shot& s) noexcept {
+  // Encoders finish out of order, the clipboard always holds the newest shot
+  std::lock_guard lock(_clipboard_mutex);
+  if (s.seq < _clipboard_seq) return;
+  _clipboard_seq = s.seq;
+
+  auto cmd = "xclip -selection clipboard -t image/png -i '" + s.path + "'";
+  if (system(cmd.c_str()) != 0) {
+    LOG("xclip failed\n");
+  }
+}
+
+void export_pool::_finish() noexcept {
+  {
+    std::lock_guard lock(_mutex);
+    _running--;
+    _in_flight--;
+  }
+
+  _idle_cv.notify_all();
+  _pump();
+}
+
+void export_pool::_pump() noexcept {
+  std::vector<shot> ready;
+
+  {
+    std::lock_guard lock(_mutex);
+
+    while (_running < _encoders && !_queue.empty()) {
+      ready.push_back(std::move(_queue.front()));
+      _queue.pop_front();
+      _running++;
+    }
+  }
+
+  // Room in the queue for a blocked submit
+  if (!ready.empty()) _idle_cv.notify_all();
+
+  for (auto& s : ready) {
+    auto shared = std::make_shared<shot>(std::move(s));
+    auto ok = std::make_shared<bool>(false);
+
+    auto encode = jobs().submit_background([this, shared, ok]() {
+      if (_handoff) {
+        LOG("Export #%u handed off\n", shared->seq);
+        *ok = _handoff->send(shared->image, shared->seq);
+        return;
+      }
+
+      LOG("Export #%u into %s\n", shared->seq, shared->path.c_str());
+
+      *ok = ExportImage(shared->image, shared->path.c_str());
+    });
+
+    job_handle archive;
+    if (_archive && shared->image.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) archive = jobs().submit_background([this, shared]() {
+      auto r = _archive->ingest((const u_char*)shared->image.data, shared->image.width, shared->image.height);
+
+      if (r.name.empty()) fprintf(stderr, "archive: can't store export #%u\n", shared->seq);
+      else fprintf(stderr, "archive: %s, %zu of %zu tiles new, %.1f KiB in %.1fms\n",
+        r.name.c_str(), r.new_tiles, r.tiles, r.stored_bytes / 1024.0, r.took_ms);
+    });
+
+    jobs().submit_background([this, shared, ok]() {
+      track_cpu(mem_cpu::EXPORT, -(ssize_t)image_bytes(shared->image));
+      UnloadImage(shared->image);
+
+      if (*ok && shared->clipboard && !_handoff) _copy_to_clipboard(*shared);
+      if (!*ok) LOG("Export #%u failed\n", shared->seq);
+
+      _finish();
+    }, { encode, archive });
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <raylib.h>
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+class export_handoff;
+class tile_archive;
+
+// Bounded export queue on the background lane of the job system. Images are handed over by
+// value and unloaded once encoded, so the render loop never touches PNG
+// encoding or xclip. At most `encoders` images are encoded at once.
+// With an archive every image is also ingested into it alongside encoding.
+// With a handoff images go to its consumer instead of files and the clipboard.
+class export_pool {
+  struct shot {
+    Image image;
+    std::string path;
+    bool clipboard;
+    uint seq;
+  };
+
+  std::deque<shot> _queue;
+  std::mutex _mutex;
+  std::condition_variable _idle_cv;
+  uint _encoders;
+  size_t _capacity;
+  tile_archive* _archive;
+  export_handoff* _handoff;
+  uint _running = 0;
+  uint _in_flight = 0;
+  uint _seq = 0;
+
+  std::mutex _clipboard_mutex;
+  uint _clipboard_seq = 0;
+
+  void _pump() noexcept;
+  void _finish() noexcept;
+  void _copy_to_clipboard(const shot& s) noexcept;
+
+public:
+  export_pool(uint encoders, size_t capacity, tile_archive* archive = nullptr, export_handoff* handoff = nullptr) noexcept;
+  ~export_pool() noexcept;
+
+  export_pool(const export_pool&) = delete;
+  export_pool& operator=(const export_pool&) = delete;
+
+  // Never blocks. Returns false when the queue is full, the image stays owned by caller.
+  bool try_submit(Image image, std::string path, bool clipboard) noexcept;
+
+  // Waits for room in the queue, for shots that must not be lost (shutdown)
+  void submit(Image image, std::string path, bool clipboard) noexcept;
+
+  uint in_flight() noexcept;
+  uint submitted() noexcept;
+};
+
+uint default_export_workers() noexcept;
@@ -0,0 +1,33 @@
+#include "fileio.h"
+
+#include <unistd.h>
+
+bool write_all(int fd, const void* data, size_t bytes, size_t offset) noexcept {
+  auto* p = (const u_char*)data;
+
+  while (bytes) {
+    auto n = pwrite(fd, p, bytes, offset);
+    if (n <= 0) return false;
+
+    p += n;
+    offset += n;
+    bytes -= n;
+  }
+
+  return true;
+}
+
+bool read_all(int fd, void* data, size_t bytes, size_t offset) noexcept {
+  auto* p = (u_char*)data;
+
+  while (bytes) {
+    auto n = pread(fd, p, bytes, offset);
+    if (n <= 0) return false;
+
+    p += n;
+    offset += n;
+    bytes -= n;
+  }
+
+  return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+
+// pwrite/pread until every byte is through, false on error or end of file
+bool write_all(int fd, const void* data, size_t bytes, size_t offset) noexcept;
+bool read_all(int fd, void* data, size_t bytes, size_t offset) noexcept;
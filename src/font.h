@@ -518,7 +518,15 @@ static const GlyphInfo fontGlyphs_Terminus[95] = {
 };
 
 // Font loading function: Terminus
-static Font LoadFont_Terminus(void)
+// NOTE: Split in two, DecompressData() is CPU only and may run off the main thread,
+// LoadFontFromData_Terminus() uploads the texture and needs GL context
+static unsigned char *InflateFontData_Terminus(void)
+{
+    int fontDataSize_Terminus = 0;
+    return DecompressData(fontData_Terminus, COMPRESSED_DATA_SIZE_FONT_TERMINUS, &fontDataSize_Terminus);
+}
+
+static Font LoadFontFromData_Terminus(unsigned char *data)
 {
     Font font = { 0 };
 
@@ -526,10 +534,6 @@ static Font LoadFont_Terminus(void)
     font.glyphCount = 95;
     font.glyphPadding = 4;
 
-    // Custom font loading
-    // NOTE: Compressed font image data (DEFLATE), it requires DecompressData() function
-    int fontDataSize_Terminus = 0;
-    unsigned char *data = DecompressData(fontData_Terminus, COMPRESSED_DATA_SIZE_FONT_TERMINUS, &fontDataSize_Terminus);
     Image imFont = { data, 512, 256, 1, 2 };
 
     // Load texture from image
@@ -543,3 +547,8 @@ static Font LoadFont_Terminus(void)
 
     return font;
 }
+
+static Font LoadFont_Terminus(void)
+{
+    return LoadFontFromData_Terminus(InflateFontData_Terminus());
+}
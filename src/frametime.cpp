@@ -0,0 +1,230 @@
+#include "frametime.h"
+
+#include <algorithm>
+#include <ctime>
+#include <numeric>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <rlgl.h>
+
+gpu_timer::gpu_timer() noexcept {
+  glGenQueries(DEPTH, _queries);
+}
+
+gpu_timer::~gpu_timer() noexcept {
+  glDeleteQueries(DEPTH, _queries);
+}
+
+void gpu_timer::_collect() noexcept {
+  GLuint64 ns = 0;
+  glGetQueryObjectui64v(_queries[_collected % DEPTH], GL_QUERY_RESULT, &ns);
+
+  _ready.push_back(ns / 1e6);
+  _collected++;
+}
+
+void gpu_timer::begin() noexcept {
+  // Ring is full, the oldest query is DEPTH frames old and most likely done anyway
+  if (_issued - _collected == DEPTH) _collect();
+
+  glBeginQuery(GL_TIME_ELAPSED, _queries[_issued % DEPTH]);
+}
+
+void gpu_timer::end() noexcept {
+  // Batched draws are only submitted at EndDrawing otherwise, outside the query
+  rlDrawRenderBatchActive();
+  glEndQuery(GL_TIME_ELAPSED);
+  _issued++;
+}
+
+bool gpu_timer::result(double* ms, bool wait) noexcept {
+  if (_ready.empty() && _collected < _issued) {
+    GLint available = 0;
+    if (!wait) glGetQueryObjectiv(_queries[_collected % DEPTH], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (wait || available) _collect();
+  }
+
+  if (_ready.empty()) return false;
+
+  *ms = _ready.front();
+  _ready.pop_front();
+  return true;
+}
+
+static int64_t monotonic_ns() noexcept {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+present_latency::present_latency() noexcept {
+  for (auto& s : _slots) glGenQueries(1, &s.query);
+}
+
+present_latency::~present_latency() noexcept {
+  for (auto& s : _slots) glDeleteQueries(1, &s.query);
+}
+
+void present_latency::_collect(slot& s) noexcept {
+  GLuint64 gpu_ns = 0;
+  glGetQueryObjectui64v(s.query, GL_QUERY_RESULT, &gpu_ns);
+  s.pending = false;
+
+  // Server time is 32 bit milliseconds, compare modulo 2^32
+  uint32_t presented_ms = (uint32_t)(((int64_t)gpu_ns + s.offset_ns) / 1000000);
+  int32_t ms = (int32_t)(presented_ms - s.event_ms);
+
+  // Negative or huge means the server clock isn't ours (remote display)
+  if (ms >= 0 && ms < 1000) samples.add(ms);
+}
+
+void present_latency::presented(uint32_t event_ms) noexcept {
+  auto& s = _slots[_issued++ % DEPTH];
+  if (s.pending) _collect(s);
+
+  GLint64 gpu_now = 0;
+  glQueryCounter(s.query, GL_TIMESTAMP);
+  glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+
+  s.offset_ns = monotonic_ns() - gpu_now;
+  s.event_ms = event_ms;
+  s.pending = true;
+
+  // Older frames that are done already
+  for (auto& o : _slots) {
+    if (!o.pending || &o == &s) continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(o.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) _collect(o);
+  }
+}
+
+void present_latency::finish() noexcept {
+  for (size_t i = 0; i < DEPTH; i++) {
+    auto& s = _slots[(_issued + i) % DEPTH];
+    if (s.pending) _collect(s);
+  }
+}
+
+double percentile(std::vector<double>& samples, double p) noexcept {
+  if (samples.empty()) return 0;
+
+  size_t i = std::min(samples.size() - 1, (size_t)(p / 100 * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + i, samples.end());
+  return samples[i];
+}
+
+double frame_times::percentile(double p) const noexcept {
+  auto sorted = samples;
+  return ::percentile(sorted, p);
+}
+
+double frame_times::mean() const noexcept {
+  return samples.empty() ? 0 : std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+}
+
+void frame_times::report(FILE* out, const char* label) const noexcept {
+  fprintf(out, "%-4s %6zu frames, mean %7.3f, p50 %7.3f, p90 %7.3f, p99 %7.3f, max %7.3f ms\n",
+    label, samples.size(), mean(), percentile(50), percentile(90), percentile(99), percentile(100));
+}
+
+frame_profiler::frame_profiler(std::initializer_list<const char*> names) noexcept
+  : _names(names), _slots(DEPTH), _cpu(WINDOW * (names.size() + 1)), _gpu(WINDOW * (names.size() + 1)) {
+  for (auto& s : _slots) {
+    s.cpu.resize(_names.size() + 1);
+    s.queries.resize(_names.size() + 1);
+    s.issued.resize(_names.size() + 1);
+  }
+}
+
+frame_profiler::~frame_profiler() noexcept {
+  if (!_queries) return;
+  for (auto& s : _slots) glDeleteQueries(s.queries.size(), s.queries.data());
+}
+
+void frame_profiler::enable(bool enabled) noexcept {
+  if (enabled && !_queries) {
+    for (auto& s : _slots) glGenQueries(s.queries.size(), s.queries.data());
+    _queries = true;
+  }
+
+  // Pending frames are dropped, the window starts over
+  for (auto& s : _slots) s.pending = false;
+  _measured = 0;
+  _enabled = enabled;
+}
+
+void frame_profiler::_collect(slot& s) noexcept {
+  const uint n = _names.size();
+  const size_t row = _measured % WINDOW * (n + 1);
+
+  GLuint64 previous = 0, first = 0;
+
+  for (uint i = 0; i <= n; i++) {
+    GLuint64 ns = previous;
+    if (s.issued[i]) glGetQueryObjectui64v(s.queries[i], GL_QUERY_RESULT, &ns);
+
+    if (i == 0) first = ns;
+    else _gpu[row + i - 1] = (ns - previous) / 1e6;
+
+    previous = ns;
+  }
+
+  _gpu[row + n] = (previous - first) / 1e6;
+
+  for (uint i = 1; i <= n; i++) {
+    if (!s.issued[i]) s.cpu[i] = s.cpu[i - 1];
+    _cpu[row + i - 1] = std::chrono::duration<double, std::milli>(s.cpu[i] - s.cpu[i - 1]).count();
+  }
+
+  _cpu[row + n] = std::chrono::duration<double, std::milli>(s.cpu[n] - s.cpu[0]).count();
+
+  s.pending = false;
+  _measured++;
+}
+
+void frame_profiler::begin() noexcept {
+  if (!_enabled) return;
+
+  auto& s = _slots[_frame++ % DEPTH];
+  if (s.pending) _collect(s);
+
+  std::fill(s.issued.begin(), s.issued.end(), false);
+  s.cpu[0] = std::chrono::steady_clock::now();
+  glQueryCounter(s.queries[0], GL_TIMESTAMP);
+
+  s.issued[0] = true;
+  s.pending = true;
+}
+
+void frame_profiler::lap(uint section) noexcept {
+  if (!_enabled || section >= _names.size()) return;
+
+  auto& s = _slots[(_frame - 1) % DEPTH];
+  if (!s.pending) return;
+
+  rlDrawRenderBatchActive();
+
+  s.cpu[section + 1] = std::chrono::steady_clock::now();
+  glQueryCounter(s.queries[section + 1], GL_TIMESTAMP);
+  s.issued[section + 1] = true;
+}
+
+static frame_profiler::timing column(const std::vector<double>& rows, uint columns, uint column, size_t count) noexcept {
+  std::vector<double> samples(count);
+  for (size_t i = 0; i < count; i++) samples[i] = rows[i * columns + column];
+
+  return { percentile(samples, 50), percentile(samples, 95), percentile(samples, 99) };
+}
+
+frame_profiler::timing frame_profiler::cpu(uint section) const noexcept {
+  return column(_cpu, _names.size() + 1, section, frames());
+}
+
+frame_profiler::timing frame_profiler::gpu(uint section) const noexcept {
+  return column(_gpu, _names.size() + 1, section, frames());
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <initializer_list>
+#include <vector>
+
+// p in 0..100, reorders samples
+double percentile(std::vector<double>& samples, double p) noexcept;
+
+// GPU time of a frame from GL_TIME_ELAPSED queries kept in a ring. Results are
+// read a few frames late so the render loop never waits on the GPU. Needs a
+// current GL context from construction to destruction.
+class gpu_timer {
+  static constexpr uint DEPTH = 8;
+
+  uint _queries[DEPTH] = {};
+  size_t _issued = 0, _collected = 0;
+  std::deque<double> _ready;
+
+  void _collect() noexcept;
+
+public:
+  gpu_timer() noexcept;
+  ~gpu_timer() noexcept;
+
+  gpu_timer(const gpu_timer&) = delete;
+  gpu_timer& operator=(const gpu_timer&) = delete;
+
+  // Around everything drawn in a frame, not nested
+  void begin() noexcept;
+  void end() noexcept;
+
+  // Oldest finished frame in ms, false when none is ready (wait blocks for the oldest issued one)
+  bool result(double* ms, bool wait = false) noexcept;
+};
+
+// Distribution of per frame times
+struct frame_times {
+  std::vector<double> samples = {};
+
+  inline void add(double ms) noexcept { samples.push_back(ms); }
+
+  double percentile(double p) const noexcept;
+  double mean() const noexcept;
+
+  // One line: count, mean, p50, p90, p99 and max in ms
+  void report(FILE* out, const char* label) const noexcept;
+};
+
+// Input to present latency against X event time stamps (server milliseconds, which
+// on Linux servers are CLOCK_MONOTONIC). A GL_TIMESTAMP query after the swap says when
+// the GPU got through the frame, the GL clock read at the same moment maps it onto
+// CLOCK_MONOTONIC. Read DEPTH frames late, never waits. Needs a current GL context.
+class present_latency {
+  static constexpr uint DEPTH = 8;
+
+  struct slot {
+    uint query = 0;
+    int64_t offset_ns = 0;
+    uint32_t event_ms = 0;
+    bool pending = false;
+  };
+
+  slot _slots[DEPTH] = {};
+  size_t _issued = 0;
+
+  void _collect(slot& s) noexcept;
+
+public:
+  frame_times samples = {};
+
+  present_latency() noexcept;
+  ~present_latency() noexcept;
+
+  present_latency(const present_latency&) = delete;
+  present_latency& operator=(const present_latency&) = delete;
+
+  // Right after the swap of a frame that reflects input stamped event_ms
+  void presented(uint32_t event_ms) noexcept;
+
+  // Collects whatever is still in flight, blocking
+  void finish() noexcept;
+};
+
+// CPU and GPU time of named sections of a frame over the last WINDOW frames.
+// GPU side is a GL_TIMESTAMP query per section boundary, read DEPTH frames late.
+// Every lap flushes the raylib batch so draws are paid for by the section that
+// issued them, which costs a few draw calls; disabled laps do nothing at all.
+class frame_profiler {
+  static constexpr uint DEPTH = 4;
+  static constexpr uint WINDOW = 240;
+
+  struct slot {
+    std::vector<std::chrono::steady_clock::time_point> cpu;
+    std::vector<uint> queries;
+    std::vector<bool> issued;
+    bool pending = false;
+  };
+
+  std::vector<const char*> _names;
+  std::vector<slot> _slots;
+
+  // WINDOW rows of section durations plus the whole frame, in ms
+  std::vector<double> _cpu, _gpu;
+  size_t _frame = 0, _measured = 0;
+  bool _enabled = false;
+  bool _queries = false;
+
+  void _collect(slot& s) noexcept;
+
+public:
+  struct timing { double p50, p95, p99; };
+
+  explicit frame_profiler(std::initializer_list<const char*> names) noexcept;
+  ~frame_profiler() noexcept;
+
+  frame_profiler(const frame_profiler&) = delete;
+  frame_profiler& operator=(const frame_profiler&) = delete;
+
+  // Queries are created on first enable, a GL context must be current then and on destruction
+  void enable(bool enabled) noexcept;
+  inline bool enabled() const noexcept { return _enabled; }
+
+  // Start of a frame, then lap(i) at the end of every section in order. Sections
+  // without a lap in some frame take no time in it.
+  void begin() noexcept;
+  void lap(uint section) noexcept;
+
+  inline uint sections() const noexcept { return _names.size(); }
+  inline const char* name(uint section) const noexcept { return _names[section]; }
+  inline size_t frames() const noexcept { return std::min<size_t>(_measured, WINDOW); }
+
+  // section == sections() is the whole frame
+  timing cpu(uint section) const noexcept;
+  timing gpu(uint section) const noexcept;
+};
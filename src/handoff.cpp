@@ -0,0 +1,168 @@
+#include "handoff.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+int handoff_memfd(const handoff_header& header, const void* data) noexcept {
+  int fd = memfd_create("boomer2-export", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) return -1;
+
+  const size_t total = HANDOFF_DATA_OFFSET + header.bytes;
+
+  if (ftruncate(fd, total) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  void* map = mmap(nullptr, total, PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+
+  memcpy(map, &header, sizeof(header));
+  memcpy((u_char*)map + HANDOFF_DATA_OFFSET, data, header.bytes);
+  munmap(map, total);
+
+  // Write seal needs the writable mapping gone, from here on the consumer can trust the contents
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+bool handoff_send(int socket, int fd, const handoff_header& header) noexcept {
+  iovec payload = { (void*)&header, sizeof(header) };
+
+  union {
+    char buffer[CMSG_SPACE(sizeof(int))];
+    cmsghdr align;
+  } control = {};
+
+  msghdr msg = {};
+  msg.msg_iov = &payload;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  ssize_t sent;
+  do sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+  while (sent < 0 && errno == EINTR);
+
+  return sent == (ssize_t)sizeof(header);
+}
+
+int handoff_receive(int socket, handoff_header* header) noexcept {
+  iovec payload = { header, sizeof(*header) };
+
+  union {
+    char buffer[CMSG_SPACE(sizeof(int))];
+    cmsghdr align;
+  } control = {};
+
+  msghdr msg = {};
+  msg.msg_iov = &payload;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+
+  ssize_t got;
+  do got = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+  while (got < 0 && errno == EINTR);
+
+  int fd = -1;
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+  if (got != (ssize_t)sizeof(*header) || memcmp(header->magic, HANDOFF_MAGIC, sizeof(HANDOFF_MAGIC))) {
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+export_handoff::export_handoff(int fd, const char* socket_path, handoff_format format) noexcept
+  : _fd(fd), _socket_path(socket_path ? socket_path : ""), _format(format) {
+  struct stat st;
+  _fd_is_socket = _fd >= 0 && fstat(_fd, &st) == 0 && S_ISSOCK(st.st_mode);
+}
+
+bool export_handoff::_write_in_place(const handoff_header& header, const void* data) noexcept {
+  if (ftruncate(_fd, HANDOFF_DATA_OFFSET + header.bytes) != 0) return false;
+
+  return pwrite(_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)
+    && pwrite(_fd, data, header.bytes, HANDOFF_DATA_OFFSET) == (ssize_t)header.bytes;
+}
+
+bool export_handoff::send(const Image& image, uint seq) noexcept {
+  if (image.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) return false;
+
+  handoff_header header = {};
+  memcpy(header.magic, HANDOFF_MAGIC, sizeof(HANDOFF_MAGIC));
+  header.version = HANDOFF_VERSION;
+  header.format = (uint32_t)_format;
+  header.width = image.width;
+  header.height = image.height;
+  header.seq = seq;
+  header.offset = HANDOFF_DATA_OFFSET;
+
+  const void* data = image.data;
+  u_char* encoded = nullptr;
+
+  if (_format == handoff_format::PNG) {
+    int size = 0;
+    encoded = ExportImageToMemory(image, ".png", &size);
+    if (!encoded) return false;
+
+    data = encoded;
+    header.bytes = size;
+  } else {
+    header.stride = image.width * 4;
+    header.bytes = (uint64_t)header.stride * image.height;
+  }
+
+  bool ok = false;
+
+  if (_fd >= 0 && !_fd_is_socket) {
+    std::lock_guard lock(_mutex);
+    ok = _write_in_place(header, data);
+  } else if (int memfd = handoff_memfd(header, data); memfd >= 0) {
+    if (_fd >= 0) {
+      std::lock_guard lock(_mutex);
+      ok = handoff_send(_fd, memfd, header);
+    } else if (int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0); sock >= 0) {
+      sockaddr_un addr = {};
+      addr.sun_family = AF_UNIX;
+      strncpy(addr.sun_path, _socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+      ok = connect(sock, (sockaddr*)&addr, sizeof(addr)) == 0 && handoff_send(sock, memfd, header);
+      close(sock);
+    }
+
+    // The consumer holds its own reference from here
+    close(memfd);
+  }
+
+  if (encoded) MemFree(encoded);
+  if (!ok) fprintf(stderr, "handoff: export #%u not delivered: %s\n", seq, strerror(errno));
+
+  return ok;
+}
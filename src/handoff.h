@@ -0,0 +1,69 @@
+#pragma once
+
+#include <raylib.h>
+#include <sys/types.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Exports handed to a local consumer without a file: every image goes into a sealed
+// memfd (header, then data at HANDOFF_DATA_OFFSET) and the descriptor is passed with
+// SCM_RIGHTS, so the consumer maps it read only and nobody copies the pixels again.
+//   --out-socket <path>  connect to a listening UNIX socket, one connection per export
+//   --out-fd <n>         inherited descriptor: a UNIX socket gets the memfd as above,
+//                        anything else (a memfd of the parent) is overwritten in place
+// Every message carries a copy of the header as its payload.
+constexpr char HANDOFF_MAGIC[8] = { 'B', 'O', 'O', 'M', 'E', 'R', '2', 'F' };
+constexpr uint32_t HANDOFF_VERSION = 1;
+
+// Page aligned, pixels can be mapped on their own
+constexpr size_t HANDOFF_DATA_OFFSET = 4096;
+
+enum class handoff_format : uint32_t {
+  RAW = 0, // RGBA8, rows of stride bytes
+  PNG = 1,
+};
+
+struct handoff_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint32_t width, height;
+  uint32_t stride;
+  uint32_t seq;
+  uint64_t offset;
+  uint64_t bytes;
+};
+
+static_assert(sizeof(handoff_header) == 48);
+
+// Sealed against writes and resizes, -1 on failure
+int handoff_memfd(const handoff_header& header, const void* data) noexcept;
+
+// One memfd over a connected UNIX socket
+bool handoff_send(int socket, int fd, const handoff_header& header) noexcept;
+
+// Descriptor of the next handoff, -1 when the peer is gone or sent something else
+int handoff_receive(int socket, handoff_header* header) noexcept;
+
+class export_handoff {
+  int _fd = -1;
+  std::string _socket_path;
+  handoff_format _format;
+
+  // Inherited descriptors are shared, one export on them at a time
+  std::mutex _mutex;
+  bool _fd_is_socket = false;
+
+  bool _write_in_place(const handoff_header& header, const void* data) noexcept;
+
+public:
+  export_handoff(int fd, const char* socket_path, handoff_format format) noexcept;
+
+  export_handoff(const export_handoff&) = delete;
+  export_handoff& operator=(const export_handoff&) = delete;
+
+  // RGBA8 image, encoded first when the format asks for it
+  bool send(const Image& image, uint seq) noexcept;
+};
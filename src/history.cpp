@@ -0,0 +1,273 @@
+#include "history.h"
+#include "buffers.h"
+#include "jobs.h"
+#include "lz.h"
+#include "memory.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+static constexpr uint HISTORY_BPP = 4;
+static constexpr size_t TILE_BYTES = (size_t)TILE_SIZE * TILE_SIZE * HISTORY_BPP;
+
+// Room for one compressed tile in the scratch buffer
+static const size_t SLOT = lz_bound(TILE_BYTES);
+
+// Records start 8 byte aligned
+static inline size_t align8(size_t n) noexcept { return (n + 7) & ~(size_t)7; }
+
+screen_history::screen_history(size_t budget, double seconds) noexcept
+  : _capacity(align8(budget)), _seconds(seconds) {
+  // Pages get committed as the head first reaches them
+  void* p = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p != MAP_FAILED) _ring = (u_char*)p;
+}
+
+screen_history::~screen_history() noexcept {
+  if (_ring) munmap(_ring, _capacity);
+  set_cpu(mem_cpu::HISTORY, 0);
+}
+
+size_t screen_history::_encode(const u_char* pixels, const tile_grid& grid, bool key) noexcept {
+  _changed.clear();
+  for (uint i = 0; i < grid.hashes.size(); i++)
+    if (key || grid.hashes[i] != _last.hashes[i]) _changed.push_back(i);
+
+  const size_t n = _changed.size();
+  _sizes.resize(n);
+  if (_scratch.size() < n * SLOT) _scratch.resize(n * SLOT);
+
+  jobs().parallel_for(0, n, 8, [&](size_t begin, size_t end) {
+    u_char tile[TILE_BYTES];
+
+    for (size_t i = begin; i < end; i++) {
+      auto r = grid.rect(_changed[i] % grid.cols, _changed[i] / grid.cols);
+      pack_rect(pixels, grid.width, grid.bpp, r, tile);
+      _sizes[i] = lz_compress(tile, (size_t)r.width * r.height * grid.bpp, _scratch.data() + i * SLOT);
+    }
+  });
+
+  size_t bytes = 4 + n * 8;
+  for (auto s : _sizes) bytes += s;
+
+  return align8(bytes);
+}
+
+// Free space at the head, or at the start when the end can't hold the record
+bool screen_history::_place(size_t bytes, size_t* offset) const noexcept {
+  if (_frames.empty()) {
+    *offset = 0;
+    return bytes <= _capacity;
+  }
+
+  const size_t tail = _frames.front().offset;
+
+  if (_head > tail) {
+    if (_capacity - _head >= bytes) *offset = _head;
+    else if (tail >= bytes) *offset = 0;
+    else return false;
+
+    return true;
+  }
+
+  *offset = _head;
+  return _head < tail && tail - _head >= bytes;
+}
+
+void screen_history::_drop_group() noexcept {
+  do _frames.pop_front();
+  while (!_frames.empty() && !_frames.front().key);
+
+  if (_frames.empty()) _head = 0;
+}
+
+bool screen_history::add(const u_char* pixels, uint width, uint height, double time) noexcept {
+  if (!_ring || !pixels) return false;
+  std::lock_guard writer(_writer);
+
+  tile_grid grid(width, height, HISTORY_BPP);
+  grid.compute(pixels);
+
+  // Only add() changes the frame list, reading it here needs no lock
+  bool key = _frames.empty() || !grid.same_layout(_last) || _since_key >= _key_bytes || time - _key_time >= _seconds / 2;
+  size_t bytes = _encode(pixels, grid, key);
+
+  if (_changed.empty()) return true;
+
+  std::unique_lock lock(_mutex);
+  size_t offset;
+  while (!_place(bytes, &offset)) {
+    if (_frames.size() > 1 && std::any_of(_frames.begin() + 1, _frames.end(), [](const frame& f) { return f.key; })) {
+      _drop_group();
+      continue;
+    }
+
+    // Only the group being built is left, this frame starts over as a key
+    if (!key) {
+      key = true;
+      lock.unlock();
+      bytes = _encode(pixels, grid, true);
+      lock.lock();
+      continue;
+    }
+
+    if (bytes > _capacity) return false;
+    _frames.clear();
+    _head = 0;
+  }
+
+  u_char* out = _ring + offset;
+  uint32_t count = _changed.size();
+  memcpy(out, &count, 4);
+
+  u_char* data = out + 4 + (size_t)count * 8;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t entry[2] = { _changed[i], (uint32_t)_sizes[i] };
+    memcpy(out + 4 + (size_t)i * 8, entry, 8);
+    memcpy(data, _scratch.data() + i * SLOT, _sizes[i]);
+    data += _sizes[i];
+  }
+
+  _head = offset + bytes;
+  _touched = std::max(_touched, _head);
+  _frames.push_back({ time, width, height, key, count, offset, bytes });
+
+  // Groups that are all older than the window, the newest one stays whatever its age
+  while (_frames.size() > 1) {
+    auto next = std::find_if(_frames.begin() + 1, _frames.end(), [](const frame& f) { return f.key; });
+    if (next == _frames.end() || next->time > time - _seconds) break;
+
+    _drop_group();
+  }
+
+  lock.unlock();
+
+  if (key) {
+    _key_bytes = bytes;
+    _since_key = 0;
+    _key_time = time;
+  } else {
+    _since_key += bytes;
+  }
+
+  _last = std::move(grid);
+
+  set_cpu(mem_cpu::HISTORY, _touched + _scratch.capacity());
+  return true;
+}
+
+size_t screen_history::frames() const noexcept {
+  std::lock_guard lock(_mutex);
+  return _frames.size();
+}
+
+screen_history::frame screen_history::info(size_t index) const noexcept {
+  std::lock_guard lock(_mutex);
+  return index < _frames.size() ? _frames[index] : frame{};
+}
+
+std::vector<double> screen_history::times() const noexcept {
+  std::lock_guard lock(_mutex);
+
+  std::vector<double> times(_frames.size());
+  for (size_t i = 0; i < _frames.size(); i++) times[i] = _frames[i].time;
+
+  return times;
+}
+
+size_t screen_history::used_bytes() const noexcept {
+  std::lock_guard lock(_mutex);
+
+  size_t bytes = 0;
+  for (auto& f : _frames) bytes += f.bytes;
+
+  return bytes;
+}
+
+u_char* screen_history::rebuild(size_t index, std::pair<uint, uint>* size) const noexcept {
+  // Records from the key up to index, copied out so add() can evict them meanwhile
+  frame f;
+  std::vector<u_char> records;
+  std::vector<size_t> record_starts;
+  {
+    std::lock_guard lock(_mutex);
+    if (index >= _frames.size()) return nullptr;
+
+    // The oldest frame is always a key
+    size_t first = index;
+    while (!_frames[first].key) first--;
+
+    size_t bytes = 0;
+    for (size_t j = first; j <= index; j++) bytes += _frames[j].bytes;
+    records.resize(bytes);
+
+    bytes = 0;
+    for (size_t j = first; j <= index; j++) {
+      memcpy(records.data() + bytes, _ring + _frames[j].offset, _frames[j].bytes);
+      record_starts.push_back(bytes);
+      bytes += _frames[j].bytes;
+    }
+
+    f = _frames[index];
+  }
+
+  auto* pixels = capture_buffers().acquire((size_t)f.width * f.height * HISTORY_BPP);
+  if (!pixels) return nullptr;
+
+  const tile_grid grid(f.width, f.height, HISTORY_BPP);
+  const size_t stride = (size_t)f.width * HISTORY_BPP;
+  std::atomic<bool> ok = true;
+  std::vector<size_t> starts;
+
+  for (size_t start : record_starts) {
+    const u_char* record = records.data() + start;
+
+    uint32_t count;
+    memcpy(&count, record, 4);
+
+    starts.resize(count);
+    size_t at = 4 + (size_t)count * 8;
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t entry[2];
+      memcpy(entry, record + 4 + (size_t)i * 8, 8);
+      starts[i] = at;
+      at += entry[1];
+    }
+
+    jobs().parallel_for(0, count, 8, [&](size_t begin, size_t end) {
+      u_char tile[TILE_BYTES];
+
+      for (size_t i = begin; i < end; i++) {
+        uint32_t entry[2];
+        memcpy(entry, record + 4 + i * 8, 8);
+
+        if (entry[0] >= grid.hashes.size()) {
+          ok = false;
+          continue;
+        }
+
+        auto r = grid.rect(entry[0] % grid.cols, entry[0] / grid.cols);
+        const size_t row = (size_t)r.width * HISTORY_BPP;
+
+        if (!lz_decompress(record + starts[i], entry[1], tile, row * r.height)) {
+          ok = false;
+          continue;
+        }
+
+        for (uint y = 0; y < r.height; y++)
+          memcpy(pixels + (r.y + y) * stride + (size_t)r.x * HISTORY_BPP, tile + y * row, row);
+      }
+    });
+  }
+
+  if (!ok) {
+    capture_buffers().release(pixels);
+    return nullptr;
+  }
+
+  *size = { f.width, f.height };
+  return pixels;
+}
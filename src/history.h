@@ -0,0 +1,80 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "tiles.h"
+
+// Last seconds of the screen in a fixed size ring, to pick a frame from before the
+// overlay was opened. A frame stores only the tiles (tile_grid hashes) that changed
+// since the previous one, LZ compressed. A key frame stores every tile and starts a
+// group that is evicted as a whole, so the oldest kept frame can always be rebuilt.
+// A new key is made once the deltas since the last one outweigh it, or half the
+// seconds after it so old groups can age out. Frames without changes aren't stored.
+//   record: u32 tiles, { u32 index, u32 bytes } per tile, compressed tiles
+class screen_history {
+public:
+  struct frame {
+    double time;
+    uint width, height;
+    bool key;
+    uint tiles;
+    size_t offset, bytes;
+  };
+
+private:
+  u_char* _ring = nullptr;
+  size_t _capacity;
+  size_t _head = 0;
+  size_t _touched = 0;
+  double _seconds;
+
+  // Frame list and head, held only to place, copy or look up records. Records don't
+  // change once written, readers copy what they need and decode without it.
+  mutable std::mutex _mutex;
+  std::deque<frame> _frames;
+
+  // One add() at a time, the rest belongs to it and is encoded without _mutex
+  std::mutex _writer;
+  tile_grid _last;
+  size_t _key_bytes = 0, _since_key = 0;
+  double _key_time = 0;
+
+  std::vector<uint32_t> _changed;
+  std::vector<size_t> _sizes;
+  std::vector<u_char> _scratch;
+
+  size_t _encode(const u_char* pixels, const tile_grid& grid, bool key) noexcept;
+  bool _place(size_t bytes, size_t* offset) const noexcept;
+  void _drop_group() noexcept;
+
+public:
+  screen_history(size_t budget, double seconds) noexcept;
+  ~screen_history() noexcept;
+
+  screen_history(const screen_history&) = delete;
+  screen_history& operator=(const screen_history&) = delete;
+
+  inline bool ok() const noexcept { return _ring; }
+
+  // RGBA8 pixels, false when not even a key frame of them fits the budget
+  bool add(const u_char* pixels, uint width, uint height, double time) noexcept;
+
+  size_t frames() const noexcept;
+  frame info(size_t index) const noexcept;
+
+  // Time of every frame, oldest first
+  std::vector<double> times() const noexcept;
+
+  // Capture buffer (see buffers.h) with frame index (0 is the oldest), nullptr on failure
+  u_char* rebuild(size_t index, std::pair<uint, uint>* size) const noexcept;
+
+  // Bytes of records in the ring
+  size_t used_bytes() const noexcept;
+  inline size_t capacity() const noexcept { return _capacity; }
+};
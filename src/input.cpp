@@ -0,0 +1,111 @@
+#include "input.h"
+
+#include <algorithm>
+#include <cstring>
+
+static constexpr char MAGIC[8] = { 'B', 'O', 'O', 'M', 'E', 'R', '2', 'I' };
+static constexpr uint32_t VERSION = 1;
+static constexpr uint16_t KEY_WENT_DOWN = 0x8000;
+
+struct header {
+  char magic[8];
+  uint32_t version;
+  uint32_t width, height;
+};
+
+struct frame_header {
+  float mouse_x, mouse_y, wheel;
+  uint8_t buttons;
+  uint8_t _reserved;
+  uint16_t transitions, chars;
+};
+
+input_writer::input_writer(const char* path, uint width, uint height) noexcept {
+  _file = fopen(path, "wb");
+  if (!_file) return;
+
+  header h = {};
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.width = width;
+  h.height = height;
+
+  if (fwrite(&h, sizeof(h), 1, _file) != 1) {
+    fclose(_file);
+    _file = nullptr;
+  }
+}
+
+input_writer::~input_writer() noexcept {
+  if (_file) fclose(_file);
+}
+
+void input_writer::write(const input_frame& frame) noexcept {
+  if (!_file) return;
+
+  uint16_t transitions[INPUT_KEYS];
+  uint16_t count = 0;
+
+  auto changed = frame.keys ^ _keys;
+  for (uint key = 0; key < INPUT_KEYS && changed.any(); key++) {
+    if (!changed[key]) continue;
+
+    transitions[count++] = key | (frame.keys[key] ? KEY_WENT_DOWN : 0);
+    changed.reset(key);
+  }
+
+  frame_header f = { frame.mouse_x, frame.mouse_y, frame.wheel, frame.buttons, 0, count, (uint16_t)std::min<size_t>(frame.chars.size(), UINT16_MAX) };
+
+  fwrite(&f, sizeof(f), 1, _file);
+  fwrite(transitions, sizeof(uint16_t), count, _file);
+  fwrite(frame.chars.data(), sizeof(uint32_t), f.chars, _file);
+
+  _keys = frame.keys;
+  _frames++;
+}
+
+input_reader::input_reader(const char* path) noexcept {
+  _file = fopen(path, "rb");
+  if (!_file) return;
+
+  header h;
+  if (fread(&h, sizeof(h), 1, _file) != 1 || memcmp(h.magic, MAGIC, sizeof(MAGIC)) || h.version != VERSION) {
+    fclose(_file);
+    _file = nullptr;
+    return;
+  }
+
+  width = h.width;
+  height = h.height;
+}
+
+input_reader::~input_reader() noexcept {
+  if (_file) fclose(_file);
+}
+
+bool input_reader::read(input_frame* frame) noexcept {
+  if (!_file) return false;
+
+  frame_header f;
+  if (fread(&f, sizeof(f), 1, _file) != 1 || f.transitions > INPUT_KEYS) return false;
+
+  uint16_t transitions[INPUT_KEYS];
+  if (fread(transitions, sizeof(uint16_t), f.transitions, _file) != f.transitions) return false;
+
+  frame->chars.resize(f.chars);
+  if (fread(frame->chars.data(), sizeof(uint32_t), f.chars, _file) != f.chars) return false;
+
+  for (uint i = 0; i < f.transitions; i++) {
+    uint key = transitions[i] & ~KEY_WENT_DOWN;
+    if (key < INPUT_KEYS) _keys[key] = transitions[i] & KEY_WENT_DOWN;
+  }
+
+  frame->mouse_x = f.mouse_x;
+  frame->mouse_y = f.mouse_y;
+  frame->wheel = f.wheel;
+  frame->buttons = f.buttons;
+  frame->keys = _keys;
+
+  _frames++;
+  return true;
+}
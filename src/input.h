@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <bitset>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// raylib key codes are below this
+constexpr uint INPUT_KEYS = 352;
+
+// Everything the main loop reads from input devices in one frame
+struct input_frame {
+  float mouse_x = 0, mouse_y = 0;
+  float wheel = 0;
+  uint8_t buttons = 0; // bit per mouse button held down
+  std::bitset<INPUT_KEYS> keys = {};
+  std::vector<uint32_t> chars = {};
+};
+
+// Per frame input log, each frame stores key transitions against the previous one.
+//   header: magic, version, window width and height
+//   frame:  mouse x, y, wheel (f32), buttons (u8), transition and char counts (u16),
+//           transitions (u16, key | 0x8000 when it went down), chars (u32)
+class input_writer {
+  FILE* _file = nullptr;
+  std::bitset<INPUT_KEYS> _keys = {};
+  size_t _frames = 0;
+
+public:
+  input_writer(const char* path, uint width, uint height) noexcept;
+  ~input_writer() noexcept;
+
+  input_writer(const input_writer&) = delete;
+  input_writer& operator=(const input_writer&) = delete;
+
+  inline bool ok() const noexcept { return _file != nullptr; }
+  inline size_t frames() const noexcept { return _frames; }
+
+  void write(const input_frame& frame) noexcept;
+};
+
+class input_reader {
+  FILE* _file = nullptr;
+  std::bitset<INPUT_KEYS> _keys = {};
+  size_t _frames = 0;
+
+public:
+  // Window size the log was recorded with
+  uint width = 0, height = 0;
+
+  explicit input_reader(const char* path) noexcept;
+  ~input_reader() noexcept;
+
+  input_reader(const input_reader&) = delete;
+  input_reader& operator=(const input_reader&) = delete;
+
+  inline bool ok() const noexcept { return _file != nullptr; }
+  inline size_t frames() const noexcept { return _frames; }
+
+  // False at the end of the log or on a damaged frame
+  bool read(input_frame* frame) noexcept;
+};
@@ -0,0 +1,236 @@
+#include "jobs.h"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+static thread_local int __worker_index = -1;
+
+job_system& jobs() noexcept {
+  const uint cores = std::max(std::thread::hardware_concurrency(), 2u);
+  static job_system instance(cores - 1, std::clamp(cores / 2, 1u, 4u));
+  return instance;
+}
+
+job_system::job_system(uint workers, uint background_workers) noexcept : _width(workers + 1) {
+  for (uint i = 0; i < workers; i++) _queues.push_back(std::make_unique<queue>());
+  for (uint i = 0; i < workers; i++) _workers.emplace_back([this, i]() { _worker(i); });
+  for (uint i = 0; i < std::max(background_workers, 1u); i++) _background_workers.emplace_back([this]() { _background_worker(); });
+}
+
+job_system::~job_system() noexcept {
+  // Background jobs may still wait on workers, they go first
+  {
+    std::lock_guard lock(_background_mutex);
+    _stop_background = true;
+  }
+
+  _background_cv.notify_all();
+  for (auto& w : _background_workers) w.join();
+
+  {
+    std::lock_guard lock(_sleep_mutex);
+    _stop = true;
+  }
+
+  _sleep_cv.notify_all();
+  for (auto& w : _workers) w.join();
+}
+
+void job_system::set_width(uint width) noexcept {
+  _width = std::clamp(width, 1u, threads());
+}
+
+job_handle job_system::submit(std::function<void()> fn, std::initializer_list<job_handle> deps) noexcept {
+  return _submit(std::move(fn), deps.begin(), deps.size(), false);
+}
+
+job_handle job_system::submit_after(std::function<void()> fn, const std::vector<job_handle>& deps) noexcept {
+  return _submit(std::move(fn), deps.data(), deps.size(), false);
+}
+
+job_handle job_system::submit_background(std::function<void()> fn, std::initializer_list<job_handle> deps) noexcept {
+  return _submit(std::move(fn), deps.begin(), deps.size(), true);
+}
+
+job_handle job_system::_submit(std::function<void()> fn, const job_handle* deps, size_t count, bool background) noexcept {
+  auto j = std::make_shared<job>();
+  j->fn = std::move(fn);
+  j->background = background;
+
+  for (size_t i = 0; i < count; i++) {
+    auto& dep = deps[i];
+    if (!dep) continue;
+
+    std::lock_guard lock(dep->mutex);
+    if (dep->finished) continue;
+
+    j->blockers++;
+    dep->continuations.push_back(j);
+  }
+
+  // Drop the submission guard, the last finished dependency schedules otherwise
+  if (--j->blockers == 0) _schedule(j);
+
+  return j;
+}
+
+void job_system::_schedule(job_handle j) noexcept {
+  if (j->background) {
+    {
+      std::lock_guard lock(_background_mutex);
+      _background.push_back(std::move(j));
+    }
+
+    _background_cv.notify_one();
+    return;
+  }
+
+  if (_queues.empty()) { _run(std::move(j)); return; }
+
+  uint index = __worker_index >= 0 ? __worker_index : _next_queue++ % _queues.size();
+
+  {
+    std::lock_guard lock(_queues[index]->mutex);
+    _queues[index]->jobs.push_back(std::move(j));
+  }
+
+  {
+    std::lock_guard lock(_sleep_mutex);
+    _pending++;
+  }
+
+  _sleep_cv.notify_one();
+}
+
+job_handle job_system::_take(int own) noexcept {
+  if (own >= 0) {
+    std::lock_guard lock(_queues[own]->mutex);
+    auto& q = _queues[own]->jobs;
+
+    if (!q.empty()) {
+      auto j = std::move(q.back());
+      q.pop_back();
+      _pending--;
+      return j;
+    }
+  }
+
+  for (size_t i = 0; i < _queues.size(); i++) {
+    auto index = (own + 1 + i) % _queues.size();
+    if ((int)index == own) continue;
+
+    std::lock_guard lock(_queues[index]->mutex);
+    auto& q = _queues[index]->jobs;
+
+    if (!q.empty()) {
+      auto j = std::move(q.front());
+      q.pop_front();
+      _pending--;
+      return j;
+    }
+  }
+
+  return nullptr;
+}
+
+void job_system::_run(job_handle j) noexcept {
+  j->fn();
+  j->fn = nullptr;
+
+  std::vector<job_handle> continuations;
+
+  {
+    std::lock_guard lock(j->mutex);
+    j->finished = true;
+    continuations.swap(j->continuations);
+  }
+
+  for (auto& c : continuations)
+    if (--c->blockers == 0) _schedule(std::move(c));
+
+  // Wake up waiters which sleep on a finished job
+  _sleep_cv.notify_all();
+}
+
+void job_system::_worker(uint index) noexcept {
+  __worker_index = index;
+
+  while (true) {
+    if (auto j = _take(index)) { _run(std::move(j)); continue; }
+
+    std::unique_lock lock(_sleep_mutex);
+    _sleep_cv.wait(lock, [this]() { return _stop || _pending > 0; });
+
+    if (_stop && _pending == 0) return;
+  }
+}
+
+void job_system::_background_worker() noexcept {
+  // Encoding must not compete with the render thread
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+
+  while (true) {
+    job_handle j;
+
+    {
+      std::unique_lock lock(_background_mutex);
+      _background_cv.wait(lock, [this]() { return _stop_background || !_background.empty(); });
+
+      if (_background.empty()) return;
+
+      j = std::move(_background.front());
+      _background.pop_front();
+    }
+
+    _run(std::move(j));
+  }
+}
+
+void job_system::_wait_until(const std::function<bool()>& ready) noexcept {
+  const bool worker = __worker_index >= 0;
+
+  while (!ready()) {
+    if (worker) if (auto other = _take(__worker_index)) { _run(std::move(other)); continue; }
+
+    std::unique_lock lock(_sleep_mutex);
+    _sleep_cv.wait_for(lock, std::chrono::milliseconds(1), [&]() { return ready() || (worker && _pending > 0); });
+  }
+}
+
+void job_system::wait(const job_handle& j) noexcept {
+  _wait_until([&]() { return done(j); });
+}
+
+void job_system::parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& fn) noexcept {
+  if (begin >= end) return;
+
+  grain = std::max<size_t>(grain, 1);
+  const size_t chunks = (end - begin + grain - 1) / grain;
+  const size_t fan_out = std::min<size_t>(chunks, _width);
+
+  // Helpers that start after the last chunk was taken find nothing to do and never touch fn,
+  // so the caller waits for chunks rather than helpers
+  struct progress {
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> completed = 0;
+  };
+
+  auto p = std::make_shared<progress>();
+
+  auto body = [p, chunks, begin, end, grain, &fn]() {
+    for (size_t chunk; (chunk = p->next++) < chunks;) {
+      auto b = begin + chunk * grain;
+      fn(b, std::min(end, b + grain));
+      p->completed++;
+    }
+  };
+
+  for (size_t i = 1; i < fan_out; i++) submit(body);
+
+  body();
+  _wait_until([&]() { return p->completed == chunks; });
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct job {
+  std::function<void()> fn;
+
+  std::atomic<int> blockers = 1;
+  std::atomic<bool> finished = false;
+  bool background = false;
+
+  std::mutex mutex;
+  std::vector<std::shared_ptr<job>> continuations = {};
+};
+
+using job_handle = std::shared_ptr<job>;
+
+// Work-stealing pool started once per process. Every worker owns a deque,
+// pops its own work LIFO and steals FIFO from the others. Waiting workers
+// execute queued jobs instead of sleeping, other threads (the render one)
+// only sleep, so they never end up running someone else's long job.
+// Background jobs (encoding, archiving) have a lane of their own, served by
+// separate lower priority threads only.
+class job_system {
+  struct queue {
+    std::mutex mutex;
+    std::deque<job_handle> jobs;
+  };
+
+  std::vector<std::thread> _workers;
+  std::vector<std::unique_ptr<queue>> _queues;
+
+  std::mutex _sleep_mutex;
+  std::condition_variable _sleep_cv;
+  std::atomic<int> _pending = 0;
+  std::atomic<uint> _next_queue = 0;
+  std::atomic<uint> _width;
+  bool _stop = false;
+
+  std::vector<std::thread> _background_workers;
+  std::deque<job_handle> _background;
+  std::mutex _background_mutex;
+  std::condition_variable _background_cv;
+  bool _stop_background = false;
+
+  void _worker(uint index) noexcept;
+  void _background_worker() noexcept;
+  job_handle _submit(std::function<void()> fn, const job_handle* deps, size_t count, bool background) noexcept;
+  void _schedule(job_handle j) noexcept;
+  void _run(job_handle j) noexcept;
+  job_handle _take(int own) noexcept;
+  void _wait_until(const std::function<bool()>& ready) noexcept;
+
+public:
+  job_system(uint workers, uint background_workers) noexcept;
+  ~job_system() noexcept;
+
+  job_system(const job_system&) = delete;
+  job_system& operator=(const job_system&) = delete;
+
+  // Job starts only after all dependencies finished.
+  job_handle submit(std::function<void()> fn, std::initializer_list<job_handle> deps = {}) noexcept;
+
+  // Dependencies known only at run time, null ones are skipped.
+  job_handle submit_after(std::function<void()> fn, const std::vector<job_handle>& deps) noexcept;
+
+  // Same on the background lane, deps may be in either lane.
+  job_handle submit_background(std::function<void()> fn, std::initializer_list<job_handle> deps = {}) noexcept;
+
+  bool done(const job_handle& j) const noexcept { return !j || j->finished; }
+
+  // Workers run other jobs until j is finished, anyone else sleeps.
+  void wait(const job_handle& j) noexcept;
+
+  // fn(begin, end) over chunks of at most grain items, caller takes part.
+  void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& fn) noexcept;
+
+  // Total threads incl. caller that parallel_for and capture conversion may fan out to (benchmark scaling).
+  inline uint width() const noexcept { return _width; }
+  void set_width(uint width) noexcept;
+
+  inline uint threads() const noexcept { return _workers.size() + 1; }
+};
+
+job_system& jobs() noexcept;
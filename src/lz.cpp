@@ -0,0 +1,126 @@
+#include "lz.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+static constexpr uint HASH_BITS = 12;
+static constexpr size_t MIN_MATCH = 4;
+
+// Matches stay clear of the tail so the last sequence is always literals
+static constexpr size_t TAIL = 12;
+
+static inline u_char* put_length(u_char* out, size_t length) noexcept {
+  while (length >= 255) {
+    *out++ = 255;
+    length -= 255;
+  }
+
+  *out++ = length;
+  return out;
+}
+
+static inline u_char* put_sequence(u_char* out, const u_char* literals, size_t literal_length, size_t offset, size_t match_length) noexcept {
+  u_char* token = out++;
+  *token = std::min<size_t>(literal_length, 15) << 4;
+
+  if (literal_length >= 15) out = put_length(out, literal_length - 15);
+
+  memcpy(out, literals, literal_length);
+  out += literal_length;
+
+  if (!match_length) return out;
+
+  *out++ = offset & 0xFF;
+  *out++ = offset >> 8;
+
+  size_t m = match_length - MIN_MATCH;
+  *token |= std::min<size_t>(m, 15);
+
+  if (m >= 15) out = put_length(out, m - 15);
+  return out;
+}
+
+size_t lz_compress(const u_char* src, size_t n, u_char* dst) noexcept {
+  uint32_t table[1 << HASH_BITS] = {};
+
+  u_char* out = dst;
+  size_t anchor = 0, i = 0;
+
+  while (n > TAIL && i < n - TAIL) {
+    uint32_t sequence;
+    memcpy(&sequence, src + i, 4);
+
+    uint32_t h = (sequence * 2654435761u) >> (32 - HASH_BITS);
+    size_t candidate = table[h];
+    table[h] = i + 1;
+
+    if (candidate && i - (candidate - 1) <= 0xFFFF && !memcmp(src + candidate - 1, src + i, MIN_MATCH)) {
+      size_t match = candidate - 1, length = MIN_MATCH;
+      while (i + length < n - TAIL && src[match + length] == src[i + length]) length++;
+
+      out = put_sequence(out, src + anchor, i - anchor, i - match, length);
+      i += length;
+      anchor = i;
+      continue;
+    }
+
+    // Skip faster through data that doesn't compress
+    i += 1 + ((i - anchor) >> 6);
+  }
+
+  return put_sequence(out, src + anchor, n - anchor, 0, 0) - dst;
+}
+
+static inline bool get_length(const u_char*& in, const u_char* end, size_t& length) noexcept {
+  u_char b;
+
+  do {
+    if (in >= end) return false;
+    b = *in++;
+    length += b;
+  } while (b == 255);
+
+  return true;
+}
+
+bool lz_decompress(const u_char* src, size_t n, u_char* dst, size_t out_n) noexcept {
+  const u_char* in = src;
+  const u_char* end = src + n;
+  u_char* out = dst;
+  u_char* out_end = dst + out_n;
+
+  while (in < end) {
+    u_char token = *in++;
+
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !get_length(in, end, literal_length)) return false;
+    if (literal_length > (size_t)(end - in) || literal_length > (size_t)(out_end - out)) return false;
+
+    memcpy(out, in, literal_length);
+    out += literal_length;
+    in += literal_length;
+
+    if (in == end) break;
+    if (end - in < 2) return false;
+
+    size_t offset = in[0] | in[1] << 8;
+    in += 2;
+
+    size_t match_length = token & 15;
+    if (match_length == 15 && !get_length(in, end, match_length)) return false;
+    match_length += MIN_MATCH;
+
+    if (!offset || offset > (size_t)(out - dst) || match_length > (size_t)(out_end - out)) return false;
+
+    const u_char* match = out - offset;
+
+    // Overlapping matches repeat the last offset bytes (runs of one colour)
+    if (offset >= match_length) memcpy(out, match, match_length);
+    else for (size_t k = 0; k < match_length; k++) out[k] = match[k];
+
+    out += match_length;
+  }
+
+  return out == out_end;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+
+// LZ4 style block codec: byte aligned literal runs and matches with 16 bit offsets,
+// no entropy stage. Fast enough to sit in front of disk for captures.
+
+inline size_t lz_bound(size_t n) noexcept { return n + n / 255 + 16; }
+
+// dst holds at least lz_bound(n) bytes, returns compressed size
+size_t lz_compress(const u_char* src, size_t n, u_char* dst) noexcept;
+
+// False on malformed input or when output isn't exactly out_n bytes
+bool lz_decompress(const u_char* src, size_t n, u_char* dst, size_t out_n) noexcept;
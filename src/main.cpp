@@ -1,20 +1,51 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <cstdio>
+#include <csignal>
+#include <cstring>
 #include <iostream>
 #include <mutex>
 #include <optional>
 #include <ostream>
+#include <GL/gl.h>
 #include <raylib.h>
 #include <raymath.h>
 #include <rlgl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/types.h>
-#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 
+#include "anim.h"
+#include "archive.h"
+#include "batch.h"
+#include "bc1.h"
+#include "buffers.h"
+#include "diff.h"
+#include "edges.h"
+#include "export.h"
 #include "font.h"
+#include "font_sdf.h"
+#include "frametime.h"
+#include "handoff.h"
+#include "history.h"
+#include "input.h"
+#include "jobs.h"
+#include "memory.h"
 #include "platform.h"
+#include "record.h"
+#include "resample.h"
+#include "session.h"
+#include "startup.h"
+#include "stats.h"
+#include "tiles.h"
+#include "wintree.h"
 
 //+Macros
   static int __COUNTER = -1;
@@ -37,6 +68,8 @@
   #define FF "(%06.1f; %06.1f)"
   #define F(v) v.x, v.y
 
+  #define MIB(usage) ((usage).live / 1048576.0), ((usage).peak / 1048576.0)
+
   #define BINARY_F "%c%c%c%c%c%c%c%c"
   #define BYTE_TO_BIN(byte)  \
     ((byte) & 0x80 ? '1' : '0'), \
@@ -149,20 +182,482 @@ using namespace std;
   }
 //-Extends default
 
-static Font font;
+//+Font
+  // Terminus is used only by overlays: inflating runs as a job, texture is uploaded on first use
+  static job_handle font_inflate;
+  static u_char* font_pixels = nullptr;
+  static optional<Font> font_cache = nullopt;
+
+  static void prefetch_font() noexcept {
+    if (font_inflate) return;
+    font_inflate = jobs().submit([]() { font_pixels = InflateFontData_Terminus(); });
+  }
+
+  static Font& get_font() noexcept {
+    if (!font_cache.has_value()) {
+      prefetch_font();
+      jobs().wait(font_inflate);
+      font_cache = LoadFontFromData_Terminus(font_pixels);
+      track_gpu("font", texture_bytes(font_cache->texture.width, font_cache->texture.height, font_cache->texture.format));
+    }
+
+    return *font_cache;
+  }
+
+  // Text annotations, distance field atlas stays sharp from 0.3 to 100 zoom
+  static const char* SDF_FRAGMENT_SHADER = R"(
+  #version 330
+
+  in vec2 fragTexCoord;
+  in vec4 fragColor;
+  out vec4 finalColor;
+
+  uniform sampler2D texture0;
+  uniform vec4 colDiffuse;
+
+  void main() {
+    float d = texture(texture0, fragTexCoord).r;
+    float w = max(fwidth(d), 1e-4);
+    finalColor = vec4(fragColor.rgb, fragColor.a * smoothstep(0.5 - w, 0.5 + w, d)) * colDiffuse;
+  }
+  )";
+
+  static optional<Font> sdf_font_cache = nullopt;
+  static Shader sdf_shader = {};
+
+  static Font& get_sdf_font() noexcept {
+    if (!sdf_font_cache.has_value()) {
+      sdf_font_cache = LoadFontSdf_Terminus();
+      track_gpu("sdf font", texture_bytes(sdf_font_cache->texture.width, sdf_font_cache->texture.height, sdf_font_cache->texture.format));
+      sdf_shader = LoadShaderFromMemory(nullptr, SDF_FRAGMENT_SHADER);
+    }
+
+    return *sdf_font_cache;
+  }
+//-Font
+
+//+Input
+  // The loop reads input only through here. Each frame is polled once from raylib, or
+  // from a --replay-input log, so a recorded session drives the very same code.
+  static constexpr int MOUSE_BUTTONS = 7;
+
+  static input_frame input = {};
+  static input_frame last_input = {};
+  static size_t next_char = 0;
+
+  static input_writer* input_recording = nullptr;
+  static input_reader* input_replay = nullptr;
+
+  // False once the replayed log runs out
+  static bool poll_input() noexcept {
+    last_input = std::move(input);
+    input = {};
+    next_char = 0;
+
+    if (input_replay) return input_replay->read(&input);
+
+    auto mouse = GetMousePosition();
+    input.mouse_x = mouse.x;
+    input.mouse_y = mouse.y;
+    input.wheel = GetMouseWheelMove();
+
+    for (int b = 0; b < MOUSE_BUTTONS; b++)
+      if (IsMouseButtonDown(b)) input.buttons |= 1 << b;
+
+    for (uint key = KEY_SPACE; key < INPUT_KEYS; key++)
+      if (IsKeyDown(key)) input.keys.set(key);
+
+    while (int c = GetCharPressed()) input.chars.push_back(c);
+
+    if (input_recording) input_recording->write(input);
+    return true;
+  }
+
+  inline vec2 mouse_position()
+  noexcept { return { input.mouse_x, input.mouse_y }; }
+
+  inline float mouse_wheel()
+  noexcept { return input.wheel; }
+
+  inline bool mouse_down(int button)
+  noexcept { return input.buttons & (1 << button); }
+
+  inline bool mouse_pressed(int button)
+  noexcept { return mouse_down(button) && !(last_input.buttons & (1 << button)); }
+
+  inline bool key_down(int key)
+  noexcept { return key >= 0 && key < (int)INPUT_KEYS && input.keys[key]; }
+
+  inline bool key_pressed(int key)
+  noexcept { return key_down(key) && !last_input.keys[key]; }
+
+  // Typed characters of this frame, 0 when there are no more
+  inline int char_pressed()
+  noexcept { return next_char < input.chars.size() ? input.chars[next_char++] : 0; }
+
+  // Hotkeys are ignored while a text annotation is being typed
+  static bool typing = false;
+
+  inline bool hotkey_down(int key)
+  noexcept { return !typing && key_down(key); }
+
+  inline bool hotkey_pressed(int key)
+  noexcept { return !typing && key_pressed(key); }
+
+  // Motion events of our window straight from X, for late latching and latency stamps
+  static pointer_latch* pointer = nullptr;
+  static pointer_motion pointer_last = {};
+  static bool pointer_moved = false;
+
+  // True when the pointer moved since the last call
+  static bool latch_pointer() noexcept {
+    if (!pointer || !pointer->poll(&pointer_last)) return false;
+
+    pointer_moved = true;
+    return true;
+  }
+//-Input
+
+// What happens to the CPU copy of the capture once it's uploaded into screenshot_texture
+enum class CpuCopy {
+  RELEASE, // give memory back to the pool
+  SPILL,   // move into an unlinked file mapping, page cache may evict it
+  KEEP,
+};
+
+struct Options {
+  // Keep overlay open after export, every shot goes to its own numbered file
+  bool session = false;
+
+  CpuCopy cpu_copy = CpuCopy::RELEASE;
+
+  // Capture is BC1 compressed on the GPU, an eighth of the VRAM; the CPU copy is spilled rather than released
+  bool compressed_texture = false;
+
+  // Print 1..N core scaling of the parallel stages and exit
+  bool bench_scaling = false;
+
+  // Print peak RSS of capture pipeline at 4K and 8K and exit
+  bool bench_memory = false;
+
+  // Print per step timings of startup after first frame
+  bool startup_report = false;
+
+  // Print frame time with the lens off and on over the capture and exit
+  bool bench_lens = false;
+
+  // Print disk use and ingest throughput of the tile archive on variants of the capture and exit
+  bool bench_archive = false;
+
+  // Print time of a 4x resample of a 1080p region of the capture and exit
+  bool bench_resample = false;
+
+  // Print throughput of handing exports over through a PNG file and through a memfd and exit
+  bool bench_handoff = false;
+
+  // Live and peak CPU bytes per subsystem and GPU bytes per texture, written on exit
+#ifdef DEBUG
+  const char* memory_json = "/tmp/__boomer2_memory.json";
+#else
+  const char* memory_json = nullptr;
+#endif
+
+  // Re-read the pointer right before drawing shapes in progress and keep the swap chain empty,
+  // report prints input to present latency of frames where the pointer moved
+  bool low_latency = false;
+  bool latency_report = false;
+
+  // Log per frame input into a file, or drive the loop from one and print frame time distributions
+  const char* record_input = nullptr;
+  const char* replay_input = nullptr;
+
+  // Enter / C adds a frame to animation written on exit, *.gif for GIF, APNG otherwise
+  const char* anim = nullptr;
+  uint anim_delay = 500;
+
+  // Stream every rendered frame: *.y4m file, "-" for stdout, "|cmd" for a pipe, raw RGBA otherwise
+  const char* record_video = nullptr;
+
+  // Highlight what changed against diff_base, next is loaded instead of capturing when given
+  const char* diff_base = nullptr;
+  const char* diff_next = nullptr;
+  u_char diff_threshold = 16;
+
+  // F2 writes capture and annotations into session_file, open reopens one instead of capturing
+  const char* open_session = nullptr;
+  const char* session_file = "/tmp/__boomer2.session";
+  bool session_compress = false;
+
+  // Every export is also stored into the tile archive, list and restore work on it without capturing
+  bool archive = false;
+  const char* archive_dir = nullptr;
+  bool archive_list = false;
+  const char* archive_restore = nullptr;
+  const char* archive_restore_path = nullptr;
+
+  // Export is resampled to scale x selection, or to size (0 for a side keeps aspect), annotations drawn at that size
+  float export_scale = 1;
+  uint export_width = 0, export_height = 0;
+  resample_filter export_filter = resample_filter::LANCZOS3;
+
+  // Annotate and export every image of a job file (see batch.h) without capturing, depth images in flight per stage
+  const char* batch = nullptr;
+  uint batch_depth = 4;
+
+  // Keep capturing the last history seconds every interval into a ring of budget MiB until
+  // SIGUSR1, then open the overlay with them to scrub through (see history.h)
+  double history = 0;
+  uint history_interval = 500;
+  uint history_budget = 64;
+
+  // Exports go to a local consumer as a memfd instead of a file (see handoff.h)
+  int out_fd = -1;
+  const char* out_socket = nullptr;
+  handoff_format out_format = handoff_format::RAW;
+
+  void parse(int argc, char** argv) noexcept {
+    for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--session")) session = true;
+      else if (!strcmp(argv[i], "--bench-scaling")) bench_scaling = true;
+      else if (!strcmp(argv[i], "--bench-memory")) bench_memory = true;
+      else if (!strcmp(argv[i], "--startup-report")) startup_report = true;
+      else if (!strcmp(argv[i], "--bench-lens")) bench_lens = true;
+      else if (!strcmp(argv[i], "--bench-archive")) bench_archive = true;
+      else if (!strcmp(argv[i], "--bench-resample")) bench_resample = true;
+      else if (!strcmp(argv[i], "--bench-handoff")) bench_handoff = true;
+      else if (!strcmp(argv[i], "--compressed-texture")) compressed_texture = true;
+      else if (!strcmp(argv[i], "--out-fd") && i + 1 < argc) out_fd = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--out-socket") && i + 1 < argc) out_socket = argv[++i];
+      else if (!strcmp(argv[i], "--out-format") && i + 1 < argc) {
+        i++;
+        if      (!strcmp(argv[i], "raw")) out_format = handoff_format::RAW;
+        else if (!strcmp(argv[i], "png")) out_format = handoff_format::PNG;
+        else fprintf(stderr, "Unknown --out-format: %s\n", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--low-latency")) low_latency = true;
+      else if (!strcmp(argv[i], "--latency-report")) latency_report = true;
+      else if (!strcmp(argv[i], "--record-input") && i + 1 < argc) record_input = argv[++i];
+      else if (!strcmp(argv[i], "--memory-json") && i + 1 < argc) memory_json = argv[++i];
+      else if (!strcmp(argv[i], "--replay-input") && i + 1 < argc) replay_input = argv[++i];
+      else if (!strcmp(argv[i], "--archive")) archive = true;
+      else if (!strcmp(argv[i], "--archive-dir") && i + 1 < argc) archive_dir = argv[++i];
+      else if (!strcmp(argv[i], "--archive-list")) archive_list = true;
+      else if (!strcmp(argv[i], "--archive-restore") && i + 2 < argc) {
+        archive_restore = argv[++i];
+        archive_restore_path = argv[++i];
+      }
+      else if (!strcmp(argv[i], "--history") && i + 1 < argc) history = std::max(atof(argv[++i]), 0.0);
+      else if (!strcmp(argv[i], "--history-interval") && i + 1 < argc) history_interval = std::max(atoi(argv[++i]), 10);
+      else if (!strcmp(argv[i], "--history-budget") && i + 1 < argc) history_budget = std::max(atoi(argv[++i]), 1);
+      else if (!strcmp(argv[i], "--batch") && i + 1 < argc) batch = argv[++i];
+      else if (!strcmp(argv[i], "--batch-depth") && i + 1 < argc) batch_depth = std::max(atoi(argv[++i]), 1);
+      else if (!strcmp(argv[i], "--record-video") && i + 1 < argc) record_video = argv[++i];
+      else if (!strcmp(argv[i], "--anim") && i + 1 < argc) anim = argv[++i];
+      else if (!strcmp(argv[i], "--anim-delay") && i + 1 < argc) anim_delay = std::clamp(atoi(argv[++i]), 10, 65535);
+      else if (!strcmp(argv[i], "--diff-base") && i + 1 < argc) diff_base = argv[++i];
+      else if (!strcmp(argv[i], "--diff-threshold") && i + 1 < argc) diff_threshold = std::clamp(atoi(argv[++i]), 0, 255);
+      else if (!strcmp(argv[i], "--open") && i + 1 < argc) open_session = argv[++i];
+      else if (!strcmp(argv[i], "--session-file") && i + 1 < argc) session_file = argv[++i];
+      else if (!strcmp(argv[i], "--session-compress")) session_compress = true;
+      else if (!strcmp(argv[i], "--diff") && i + 2 < argc) {
+        diff_base = argv[++i];
+        diff_next = argv[++i];
+      }
+      else if (!strcmp(argv[i], "--scale") && i + 1 < argc) export_scale = std::max(atof(argv[++i]), 0.01);
+      else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+        i++;
+        if (sscanf(argv[i], "%ux%u", &export_width, &export_height) < 1) fprintf(stderr, "Bad --size, expected WxH: %s\n", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--resample") && i + 1 < argc) {
+        i++;
+        if      (!strcmp(argv[i], "lanczos")) export_filter = resample_filter::LANCZOS3;
+        else if (!strcmp(argv[i], "bicubic")) export_filter = resample_filter::BICUBIC;
+        else fprintf(stderr, "Unknown --resample filter: %s\n", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--cpu-copy") && i + 1 < argc) {
+        i++;
+        if      (!strcmp(argv[i], "release")) cpu_copy = CpuCopy::RELEASE;
+        else if (!strcmp(argv[i], "spill"))   cpu_copy = CpuCopy::SPILL;
+        else if (!strcmp(argv[i], "keep"))    cpu_copy = CpuCopy::KEEP;
+        else fprintf(stderr, "Unknown --cpu-copy mode: %s\n", argv[i]);
+      }
+      else fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+    }
+  }
+};
+
+static Options options;
+
+// --history ring, frames of it are scrubbed through in the overlay
+static screen_history* history = nullptr;
+
+static inline double history_now() noexcept {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 enum Tools {
   CROSSHAIR = 1,
   LINE      = 2,
   RECTANGLE = 4,
   ARROW     = 8,
+  REDACT    = 16,
+};
+static int count_tools = 5;
+
+struct TextNote {
+  vec2 position;
+  string text;
+  float size;
+};
+
+// Screen pixels at the zoom a note was placed with
+static constexpr float TEXT_SIZE = 32;
+
+struct Redaction {
+  optional<vec2> first = nullopt;
+  optional<vec2> second = nullopt;
+  bool pixelate = false;
+};
+
+// Redactions copy rects out of a blurred copy of the capture made once per capture, so
+// their cost doesn't depend on count or size, and export draws the very same texels.
+static const char* BLUR_FRAGMENT_SHADER = R"(
+#version 330
+
+in vec2 fragTexCoord;
+out vec4 finalColor;
+
+uniform sampler2D texture0;
+uniform vec2 direction;
+
+const int RADIUS = 16;
+const float SIGMA = 7.0;
+
+void main() {
+  vec4 sum = vec4(0.0);
+  float total = 0.0;
+
+  for (int i = -RADIUS; i <= RADIUS; i++) {
+    float w = exp(-float(i * i) / (2.0 * SIGMA * SIGMA));
+    sum += texture(texture0, fragTexCoord + direction * float(i)) * w;
+    total += w;
+  }
+
+  finalColor = vec4((sum / total).rgb, 1.0);
+}
+)";
+
+// Blocks are snapped in texture space, same grid on screen at any zoom and in export
+static const char* PIXELATE_FRAGMENT_SHADER = R"(
+#version 330
+
+in vec2 fragTexCoord;
+out vec4 finalColor;
+
+uniform sampler2D texture0;
+uniform vec2 size;
+uniform float block;
+
+void main() {
+  vec2 texel = (floor(fragTexCoord * size / block) + 0.5) * block;
+  finalColor = texture(texture0, min(texel, size - 0.5) / size);
+}
+)";
+
+static constexpr float PIXELATE_BLOCK = 12;
+
+// Magnifier following the cursor, one textured quad over screenshot_texture. Shape mask,
+// pixel grid and rim are done in the same fragment pass.
+static const char* LENS_FRAGMENT_SHADER = R"(
+#version 330
+
+in vec2 fragTexCoord;
+out vec4 finalColor;
+
+uniform sampler2D texture0;
+uniform vec4 source;
+uniform vec2 size;
+uniform int circle;
+uniform int grid;
+
+void main() {
+  vec2 local = (fragTexCoord - source.xy) / source.zw * 2.0 - 1.0;
+  float edge = circle == 1 ? length(local) : max(abs(local.x), abs(local.y));
+  if (edge > 1.0) discard;
+
+  vec4 color = texture(texture0, fragTexCoord);
+
+  // Grid only once a texel spans a few screen pixels
+  vec2 texel = fragTexCoord * size;
+  vec2 step = fwidth(texel);
+  if (grid == 1 && step.x < 0.25) {
+    vec2 d = fract(texel) / step;
+    if (min(d.x, d.y) < 1.0) color.rgb = mix(color.rgb, vec3(0.0), 0.35);
+  }
+
+  if (edge > 1.0 - 2.0 * fwidth(edge)) color = vec4(1.0, 0.0, 1.0, 1.0);
+  finalColor = color;
+}
+)";
+
+static constexpr float LENS_RADIUS = 120;
+static constexpr float LENS_MIN_ZOOM = 2, LENS_MAX_ZOOM = 64;
+
+static const char* DIFF_FRAGMENT_SHADER = R"(
+#version 330
+
+in vec2 fragTexCoord;
+out vec4 finalColor;
+
+uniform sampler2D texture0;
+uniform float time;
+
+void main() {
+  if (texture(texture0, fragTexCoord).r < 0.5) discard;
+  finalColor = vec4(1.0, 0.1, 0.4, 0.35 + 0.15 * sin(time * 6.0));
+}
+)";
+
+// Selection edges snap to colour transitions within SNAP_RADIUS screen pixels that
+// run along at least SNAP_MIN of the 2 * SNAP_REACH pixels around the cursor
+static constexpr float SNAP_RADIUS = 8;
+static constexpr uint SNAP_REACH = 32;
+static constexpr uint SNAP_MIN = 12;
+
+// Compositor needs a moment to drop our window from the root before it's grabbed again
+static constexpr double RECAPTURE_HIDE_DELAY = 0.1;
+
+// F3 frame time breakdown, sections in the order the loop runs them
+enum class Section : uint {
+  INPUT, UPDATE, TEXTURE, REDACTIONS, DIFF, TOOLS,
+  SHADING, SELECTION, CROSSHAIRS, LINES, ARROWS, RECTANGLES, TEXTS, WINDOW,
+  LENS, OVERLAYS, PRESENT,
 };
-static int count_tools = 4;
+
+// Created with the window, queries need its GL context
+static frame_profiler* profiler = nullptr;
 
 struct State {
   pair<uint, uint> screen_size;
   u_char* screenshot_data;
   Texture2D screenshot_texture;
+  tile_grid tiles;
+
+  // screenshot_data is read by hashing, edge detection and diffing until these finish
+  job_handle hash_job;
+  job_handle edges_job;
+  job_handle diff_job;
+
+  edge_index edges;
+  bool snap = true;
+
+  // Window tree is queried alongside the capture, hover picking waits for it without blocking
+  job_handle windows_job;
+  window_index windows;
+  const tile_rect* hovered_window = nullptr;
+  bool cpu_copy_settled = false;
+  // screenshot_data was read back from the texture by cpu_pixels() after a release
+  bool cpu_readback = false;
   Camera2D camera = {};
 
   optional<vec2> first_point = nullopt;
@@ -179,6 +674,52 @@ struct State {
   vector<pair<optional<vec2>, optional<vec2>>> lines = {};
   vector<pair<optional<vec2>, optional<vec2>>> arrows = {};
   vector<pair<optional<vec2>, optional<vec2>>> rectangles = {};
+  vector<Redaction> redactions = {};
+  vector<TextNote> texts = {};
+  optional<TextNote> editing_text = nullopt;
+
+  bool redact_pixelate = false;
+  bool redact_dirty = true;
+  RenderTexture2D redact_texture = {};
+  Shader blur_shader = {};
+  Shader pixelate_shader = {};
+
+  enum class Recapture { IDLE, HIDING, CAPTURING };
+
+  Recapture recapture = Recapture::IDLE;
+  double recapture_started = 0;
+  job_handle recapture_job;
+  pair<uint, uint> recaptured_size;
+  u_char* recaptured_data = nullptr;
+  tile_grid recaptured_tiles;
+  edge_index recaptured_edges;
+  window_index recaptured_windows;
+
+  u_char* diff_base = nullptr;
+  pair<uint, uint> diff_base_size;
+  diff_result diff;
+  bool diff_ready = false;
+  Texture2D diff_texture = {};
+  Shader diff_shader = {};
+  int diff_time_loc = -1;
+  int diff_index = -1;
+
+  // Frame of --history on screen, -1 for the newest. The one being recaptured replaces it
+  // once it's on screen.
+  int history_index = -1;
+  int recaptured_history = -1;
+
+  enum class Lens { OFF, CIRCLE, SQUARE };
+
+  Lens lens = Lens::OFF;
+  float lens_zoom = 4;
+  bool lens_grid = false;
+  Shader lens_shader = {};
+  // Capture with the redactions drawn in, what the lens magnifies while there are any
+  RenderTexture2D lens_texture = {};
+
+  bool show_stats = false;
+  selection_stats stats;
 
   inline State* activate_tools(Tools tool)
   noexcept { this->tools |= tool; return this; }
@@ -248,8 +789,22 @@ struct State {
       ->_recalc_min_max_points();
   }
 
-  State* set_first_point(vec2 p) noexcept { return _set_point(p, &first_point, &second_point); }
-  State* set_second_point(vec2 p) noexcept { return _set_point(p, &second_point, &first_point); }
+  // Left Alt places the point exactly where the cursor is
+  vec2 _snap(vec2 p) noexcept {
+    if (!snap || key_down(KEY_LEFT_ALT) || !jobs().done(edges_job)) return p;
+    if (p.x < 0 || p.y < 0) return p;
+
+    uint radius = Clamp(SNAP_RADIUS / camera.zoom, 1, TILE_SIZE / 2);
+    uint x = roundf(p.x), y = roundf(p.y);
+
+    return {
+      (float)edges.snap_x(x, y, radius, SNAP_REACH, SNAP_MIN),
+      (float)edges.snap_y(x, y, radius, SNAP_REACH, SNAP_MIN),
+    };
+  }
+
+  State* set_first_point(vec2 p) noexcept { return _set_point(_snap(p), &first_point, &second_point); }
+  State* set_second_point(vec2 p) noexcept { return _set_point(_snap(p), &second_point, &first_point); }
 
   State* draw_shading() noexcept {
     if (!this->first_point.has_value() || !this->second_point.has_value()) return this;
@@ -304,8 +859,8 @@ struct State {
     const auto space = radius * count_tools;
 
     for (int i = 0; i < count_tools; i++) {
-      const float x = GetMousePosition().x + cos(i) * radius*4;
-      const float y = GetMousePosition().y + sin(i) * radius*4;
+      const float x = mouse_position().x + cos(i) * radius*4;
+      const float y = mouse_position().y + sin(i) * radius*4;
 
       DrawCircleLines(x, y, radius, BLACK);
       DrawCircleGradient(x, y, radius, {230, 230, 230, 100}, {255, 255, 255, 100});
@@ -315,10 +870,11 @@ struct State {
       }
 
       switch (i) {
-        case 0: DrawTextEx(font, "Cr", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
-        case 1: DrawTextEx(font, "Li", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
-        case 2: DrawTextEx(font, "Re", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
-        case 3: DrawTextEx(font, "Ar", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
+        case 0: DrawTextEx(get_font(), "Cr", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
+        case 1: DrawTextEx(get_font(), "Li", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
+        case 2: DrawTextEx(get_font(), "Re", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
+        case 3: DrawTextEx(get_font(), "Ar", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
+        case 4: DrawTextEx(get_font(), "Rd", { static_cast<float>(x - radius/2.0f), y - radius/2.0f }, radius, 1, BLACK); break;
       }
     }
 
@@ -328,7 +884,7 @@ struct State {
   State* draw_debug_line() {
     static char debug_buffer[2048];
 
-    auto texture_pos = GetScreenToWorld2D(GetMousePosition(), camera);
+    auto texture_pos = GetScreenToWorld2D(mouse_position(), camera);
     auto selection_pos = texture_pos - *first_point;
 
     sprintf(debug_buffer,
@@ -338,8 +894,10 @@ struct State {
       "FPS: %d, "
       "Tools: " BINARY_F
       "\n\n"
-      "Last rectangle: [" FF ", " FF "], Crosshair: " FF,
-      F(GetMousePosition()),
+      "Last rectangle: [" FF ", " FF "], Crosshair: " FF
+      "\n\n"
+      "MiB live/peak: capture %.1f/%.1f, conversion %.1f/%.1f, annotations %.2f/%.2f, export %.1f/%.1f, history %.1f/%.1f, GPU %.1f/%.1f",
+      F(mouse_position()),
       F(texture_pos),
       F(selection_pos),
       GetFPS(),
@@ -349,11 +907,17 @@ struct State {
       rectangles.size() > 0 ? rectangles.back().second->x : 0.0,
       rectangles.size() > 0 ? rectangles.back().second->y : 0.0,
       crosshairs.size() > 0 ? crosshairs.back().x : 0.0,
-      crosshairs.size() > 0 ? crosshairs.back().y : 0.0
+      crosshairs.size() > 0 ? crosshairs.back().y : 0.0,
+      MIB(cpu_usage(mem_cpu::CAPTURE)),
+      MIB(cpu_usage(mem_cpu::CONVERSION)),
+      MIB(cpu_usage(mem_cpu::ANNOTATIONS)),
+      MIB(cpu_usage(mem_cpu::EXPORT)),
+      MIB(cpu_usage(mem_cpu::HISTORY)),
+      MIB(gpu_usage())
     );
 
-    DrawRectangle(0, 0, swidth(), 80, {40, 40, 40, 150});
-    DrawTextEx(font, debug_buffer, {5, 5}, 32, 1, GREEN);
+    DrawRectangle(0, 0, swidth(), 120, {40, 40, 40, 150});
+    DrawTextEx(get_font(), debug_buffer, {5, 5}, 32, 1, GREEN);
 
     return this;
   }
@@ -420,6 +984,169 @@ struct State {
   }
 
 
+  // Blurred copy of screenshot_texture, stored bottom up like any render texture.
+  // Call outside of drawing, texture mode drops the camera transform.
+  State* prepare_redaction() noexcept {
+    if (!redact_dirty && redact_texture.id) return this;
+
+    if (!blur_shader.id) {
+      blur_shader = LoadShaderFromMemory(nullptr, BLUR_FRAGMENT_SHADER);
+      pixelate_shader = LoadShaderFromMemory(nullptr, PIXELATE_FRAGMENT_SHADER);
+    }
+
+    const int w = screenshot_texture.width, h = screenshot_texture.height;
+
+    if (redact_texture.texture.width != w || redact_texture.texture.height != h) {
+      if (redact_texture.id) UnloadRenderTexture(redact_texture);
+      redact_texture = LoadRenderTexture(w, h);
+      track_gpu("redaction blur", render_texture_bytes(w, h));
+    }
+
+    auto pass = LoadRenderTexture(w, h);
+    track_gpu("redaction pass", render_texture_bytes(w, h));
+    SetTextureWrap(screenshot_texture, TEXTURE_WRAP_CLAMP);
+    SetTextureWrap(pass.texture, TEXTURE_WRAP_CLAMP);
+
+    auto direction_loc = GetShaderLocation(blur_shader, "direction");
+    vec2 direction = { 1.0f / w, 0 };
+    SetShaderValue(blur_shader, direction_loc, &direction, SHADER_UNIFORM_VEC2);
+
+    BeginTextureMode(pass);
+      BeginShaderMode(blur_shader);
+        DrawTexture(screenshot_texture, 0, 0, WHITE);
+      EndShaderMode();
+    EndTextureMode();
+
+    direction = { 0, 1.0f / h };
+    SetShaderValue(blur_shader, direction_loc, &direction, SHADER_UNIFORM_VEC2);
+
+    BeginTextureMode(redact_texture);
+      BeginShaderMode(blur_shader);
+        DrawTextureRec(pass.texture, { 0, 0, (float)w, (float)-h }, { 0, 0 }, WHITE);
+      EndShaderMode();
+    EndTextureMode();
+
+    UnloadRenderTexture(pass);
+    track_gpu("redaction pass", 0);
+
+    vec2 size = { (float)w, (float)h };
+    float block = PIXELATE_BLOCK;
+    SetShaderValue(pixelate_shader, GetShaderLocation(pixelate_shader, "size"), &size, SHADER_UNIFORM_VEC2);
+    SetShaderValue(pixelate_shader, GetShaderLocation(pixelate_shader, "block"), &block, SHADER_UNIFORM_FLOAT);
+
+    redact_dirty = false;
+    return this;
+  }
+
+  // area in capture coordinates, upright for screen, upside down for render textures
+  State* _draw_redaction(const Redaction& r, Rectangle area, vec2 position, bool upright) noexcept {
+    if (!redact_texture.id || area.width < 1 || area.height < 1) return this;
+
+    Rectangle source = {
+      area.x,
+      redact_texture.texture.height - area.y - area.height,
+      area.width,
+      upright ? -area.height : area.height,
+    };
+
+    if (r.pixelate) BeginShaderMode(pixelate_shader);
+    DrawTextureRec(redact_texture.texture, source, position, WHITE);
+    if (r.pixelate) EndShaderMode();
+
+    return this;
+  }
+
+  State* draw_redactions() noexcept {
+      int i = 0;
+      for (auto& r : redactions) {
+        if (i++ == redactions.size() - 1 && !check_tools(Tools::REDACT)) break;
+        if (!r.first.has_value() || !r.second.has_value()) break;
+
+        auto area = rect_from_vectors(*r.first, *r.second);
+        _draw_redaction(r, area, { area.x, area.y }, true);
+      }
+
+      return this;
+  }
+
+  State* update_last_redaction_first_point(vec2 l) noexcept {
+    if (redactions.size() < 1) redactions.push_back({});
+    redactions.back().first = round(l);
+    redactions.back().pixelate = redact_pixelate;
+    return this;
+  }
+
+  State* update_last_redaction_second_point(vec2 l) noexcept {
+    if (redactions.size() < 1) redactions.push_back({});
+    redactions.back().second = round(l);
+    redactions.back().pixelate = redact_pixelate;
+    return this;
+  }
+
+  State* add_new_redaction() noexcept {
+    redactions.push_back({});
+    return this;
+  }
+
+  State* remove_redaction() noexcept {
+    if (redactions.size() > 0) redactions.pop_back();
+    return this;
+  }
+
+
+  State* begin_text(vec2 position) noexcept {
+    editing_text = TextNote{ round(position), "", TEXT_SIZE / camera.zoom };
+
+    // Key that started typing is queued as a character too
+    while (char_pressed()) {}
+    SetExitKey(KEY_NULL);
+
+    return this;
+  }
+
+  State* update_text() noexcept {
+    if (!editing_text.has_value()) return this;
+
+    while (int c = char_pressed())
+      if (c >= 32 && c < 127) editing_text->text += (char)c;
+
+    if (key_pressed(KEY_BACKSPACE) && !editing_text->text.empty()) editing_text->text.pop_back();
+
+    if (key_pressed(KEY_ENTER) || key_pressed(KEY_ESCAPE)) {
+      if (key_pressed(KEY_ENTER) && !editing_text->text.empty()) texts.push_back(*editing_text);
+
+      editing_text = nullopt;
+      SetExitKey(KEY_ESCAPE);
+    }
+
+    return this;
+  }
+
+  State* remove_text() noexcept {
+    if (texts.size() > 0) texts.pop_back();
+    return this;
+  }
+
+  // All notes share atlas and shader, raylib batches them into one draw call
+  State* draw_texts() noexcept {
+    if (texts.empty() && !editing_text.has_value()) return this;
+
+    auto& font = get_sdf_font();
+
+    BeginShaderMode(sdf_shader);
+      for (auto& t : texts)
+        DrawTextEx(font, t.text.c_str(), t.position, t.size, t.size / font.baseSize, MAGENTA);
+
+      if (editing_text.has_value()) {
+        auto caret = editing_text->text + (fmod(GetTime(), 1.0) < 0.5 ? "_" : " ");
+        DrawTextEx(font, caret.c_str(), editing_text->position, editing_text->size, editing_text->size / font.baseSize, MAGENTA);
+      }
+    EndShaderMode();
+
+    return this;
+  }
+
+
   State* update_last_rectangle_first_point(vec2 l) noexcept {
     if (rectangles.size() < 1) rectangles.push_back({});
 
@@ -503,6 +1230,21 @@ struct State {
     return this;
   }
 
+  // --low-latency: shapes in progress follow the pointer as of now rather than as of frame start
+  State* late_latch() noexcept {
+    if (!options.low_latency || !latch_pointer()) return this;
+
+    auto p = GetScreenToWorld2D({ (float)pointer_last.x, (float)pointer_last.y }, camera);
+
+    if (select_area_in_progress) set_second_point(p);
+    if (check_tools(Tools::CROSSHAIR)) update_last_crosshair(p);
+    if (check_tools(Tools::LINE)) update_last_line_second_point(p);
+    if (check_tools(Tools::ARROW)) update_last_arrow_second_point(p);
+    if (check_tools(Tools::RECTANGLE)) update_last_rectangle_second_point(p);
+
+    return this;
+  }
+
 
   State* update_last_crosshair(vec2 v) noexcept {
     if (crosshairs.size() < 1) crosshairs.push_back({});
@@ -520,141 +1262,1658 @@ struct State {
     return this;
   }
 
-  Image render_screenshot_and_close() {
-    LOG("Begin load image from texture\n");
-
-    auto screen_first_point = min_point.value_or(vec2{ 0, 0 });
-    auto screen_second_point = max_point.value_or(vec2{
-      static_cast<float>(swidth()),
-      static_cast<float>(sheight())
-    });
-
-    if (screen_first_point == screen_second_point) {
-      screen_first_point = {0, 0};
-      screen_second_point = {
-        static_cast<float>(swidth()),
-        static_cast<float>(sheight())
-      };
-    }
+  void track_screenshot_texture() noexcept {
+    auto& t = screenshot_texture;
+    size_t bytes = lossy_texture() ? bc1_bytes(t.width, t.height) : texture_bytes(t.width, t.height, t.format, t.mipmaps);
+    track_gpu("screenshot", t.id ? bytes : 0);
+  }
 
-    auto width = screen_second_point.x - screen_first_point.x;
-    auto height = screen_second_point.y - screen_first_point.y;
+  size_t annotation_bytes() const noexcept {
+    size_t bytes = crosshairs.capacity() * sizeof(crosshairs[0])
+      + (lines.capacity() + arrows.capacity() + rectangles.capacity()) * sizeof(lines[0])
+      + redactions.capacity() * sizeof(redactions[0])
+      + texts.capacity() * sizeof(texts[0]);
 
-    auto render_screenshot_texture = LoadRenderTexture(screen_second_point.x - screen_first_point.x, screen_second_point.y - screen_first_point.y);
+    // Short strings live inside the note itself
+    for (auto& t : texts)
+      if (t.text.capacity() > sizeof(string)) bytes += t.text.capacity() + 1;
 
-    // Render all objects into texture
-    BeginDrawing();
-      BeginTextureMode(render_screenshot_texture);
-        DrawTextureRec(screenshot_texture, {
-          screen_first_point.x,
-          screen_first_point.y,
-          width,
-          -height,
-        }, {0, 0}, {255, 255, 255, 255});
+    return bytes;
+  }
 
-        int i = 0;
-        for (auto& c : crosshairs) {
-          if (i++ == crosshairs.size() - 1 && !check_tools(Tools::CROSSHAIR)) break;
-          auto selection_pos = c - *min_point;
+  Image capture_image(u_char* data) noexcept {
+    return (Image){
+        .data = data,
+        .width = (int)swidth(),
+        .height = (int)sheight(),
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+  }
 
-          DrawCrosshair(
-            {
-              { 0,     height - selection_pos.y },
-              { width, height - selection_pos.y },
-            },
-            {
-              { selection_pos.x, 0},
-              { selection_pos.x, height },
-            }
-          );
+  // Texels differ from the capture, anything lossless comes from the CPU copy
+  inline bool lossy_texture()
+  noexcept { return screenshot_texture.format == PIXELFORMAT_COMPRESSED_DXT1_RGB; }
+
+  // --compressed-texture encodes on the CPU first, RGBA8 when the driver has no S3TC
+  Texture2D load_screenshot_texture(u_char* data) noexcept {
+    if (options.compressed_texture) {
+      u_char* blocks = capture_buffers().acquire(bc1_bytes(swidth(), sheight()));
+
+      if (blocks) {
+        auto start = GetTime();
+        bc1_compress(data, swidth(), sheight(), blocks);
+        auto encoded = GetTime();
+
+        Texture2D texture = {
+          .id = bc1_upload(blocks, swidth(), sheight()),
+          .width = (int)swidth(),
+          .height = (int)sheight(),
+          .mipmaps = 1,
+          .format = PIXELFORMAT_COMPRESSED_DXT1_RGB,
+        };
+
+        // Upload time as the driver sees it, not when it gets around to it
+        glFinish();
+        auto uploaded = GetTime();
+        capture_buffers().release(blocks);
+
+        if (texture.id) {
+          size_t rgba = (size_t)swidth() * sheight() * CAPTURE_BPP, bc1 = bc1_bytes(swidth(), sheight());
+          fprintf(stderr, "compressed texture: BC1 %ux%u, %.1f MiB instead of %.1f MiB, encode %.1fms, upload %.1fms\n",
+            swidth(), sheight(), bc1 / 1048576.0, rgba / 1048576.0, (encoded - start) * 1000, (uploaded - encoded) * 1000);
+          return texture;
         }
+      }
 
-        i = 0;
-        for (auto& [f, s] : lines) {
-          if (i++ == lines.size() - 1 && !check_tools(Tools::LINE)) break;
-          auto f_ = *f - *min_point;
-          auto s_ = *s - *min_point;
+      fprintf(stderr, "compressed texture: BC1 unavailable, uploading RGBA8\n");
+    }
 
-          DrawLineEx(
-            { f_.x, height - f_.y },
-            { s_.x, height - s_.y },
-            5,
-            MAGENTA
-          );
-        }
+    return LoadTextureFromImage(capture_image(data));
+  }
 
-        i = 0;
-        for (auto& [f, s] : rectangles) {
-          if (i++ == rectangles.size() - 1 && !check_tools(Tools::RECTANGLE)) break;
-          auto f_ = *f - *min_point;
-          auto s_ = *s - *min_point;
+  // Pixels already live in screenshot_texture, the CPU copy is kept only on request
+  State* settle_cpu_copy() noexcept {
+    // Can't be read back from a lossy texture
+    auto mode = options.cpu_copy == CpuCopy::RELEASE && lossy_texture() ? CpuCopy::SPILL : options.cpu_copy;
 
-          DrawRectangleRoundedLines(rect_from_vectors(
-            { f_.x, height - f_.y },
-            { s_.x, height - s_.y }
-          ), 0.05, 10, 5, MAGENTA);
-        }
+    switch (mode) {
+      case CpuCopy::RELEASE:
+        release_screenshot(screenshot_data);
+        screenshot_data = nullptr;
+        break;
 
-        i = 0;
-        for (auto& [f, s] : arrows) {
-          if (i++ == arrows.size() - 1 && !check_tools(Tools::ARROW)) break;
-          auto f_ = *f - *min_point;
-          auto s_ = *s - *min_point;
-          f_.y = height - f_.y;
-          s_.y = height - s_.y;
+      case CpuCopy::SPILL:
+        screenshot_data = capture_buffers().spill(screenshot_data);
+        break;
 
-          DrawArrow(pair<vec2, vec2>( f_, s_ ));
-        }
-      EndTextureMode();
-    EndDrawing();
+      case CpuCopy::KEEP:
+        break;
+    }
 
-    return LoadImageFromTexture(render_screenshot_texture.texture);;
+    stats.reset(nullptr, 0);
+    return this;
   }
-};
+
+  // Overlays reading pixels get them back from GPU when the CPU copy was released
+  const u_char* cpu_pixels() noexcept {
+    if (screenshot_data) return screenshot_data;
+
+    Image image = LoadImageFromTexture(screenshot_texture);
+    track_cpu(mem_cpu::CONVERSION, image_bytes(image));
+
+    screenshot_data = capture_buffers().acquire((size_t)swidth() * sheight() * CAPTURE_BPP);
+    if (screenshot_data) memcpy(screenshot_data, image.data, (size_t)swidth() * sheight() * CAPTURE_BPP);
+    cpu_readback = screenshot_data;
+
+    track_cpu(mem_cpu::CONVERSION, -(ssize_t)image_bytes(image));
+    UnloadImage(image);
+
+    LOG("CPU copy read back from texture\n");
+    return screenshot_data;
+  }
+
+  // Read back copy goes again once the stats panel, the only reader that keeps it across frames, is closed
+  State* drop_cpu_readback() noexcept {
+    if (!cpu_readback || show_stats) return this;
+
+    release_screenshot(screenshot_data);
+    screenshot_data = nullptr;
+    cpu_readback = false;
+    stats.reset(nullptr, 0);
+
+    return this;
+  }
+
+  // Selection in whole pixels, the whole capture when nothing is selected
+  tile_rect selection_rect() noexcept {
+    if (!min_point.has_value() || !max_point.has_value() || *min_point == *max_point)
+      return { 0, 0, swidth(), sheight() };
+
+    uint x0 = Clamp(min_point->x, 0, swidth()), y0 = Clamp(min_point->y, 0, sheight());
+    uint x1 = Clamp(max_point->x, 0, swidth()), y1 = Clamp(max_point->y, 0, sheight());
+
+    return { x0, y0, x1 - x0, y1 - y0 };
+  }
+
+  inline bool reading_cpu_copy()
+  noexcept { return !jobs().done(hash_job) || !jobs().done(edges_job) || !jobs().done(diff_job); }
+
+  State* begin_recapture() noexcept {
+    if (recapture != Recapture::IDLE || reading_cpu_copy()) return this;
+
+    SetWindowState(FLAG_WINDOW_HIDDEN);
+    recapture = Recapture::HIDING;
+    recapture_started = GetTime();
+
+    return this;
+  }
+
+  State* _apply_recapture() noexcept {
+    auto start = GetTime();
+
+    if (recaptured_size != screen_size) {
+      UnloadTexture(screenshot_texture);
+      screen_size = recaptured_size;
+      screenshot_texture = load_screenshot_texture(recaptured_data);
+      track_screenshot_texture();
+    } else if (lossy_texture()) {
+      // Blocks don't line up with changed tiles at the edges, encoding it all is cheap enough
+      UnloadTexture(screenshot_texture);
+      screenshot_texture = load_screenshot_texture(recaptured_data);
+    } else {
+      static vector<u_char> scratch;
+      static vector<size_t> offsets;
+      size_t uploaded = 0;
+
+      auto runs = recaptured_tiles.diff(tiles);
+      pack_rects(recaptured_data, swidth(), tiles.bpp, runs, scratch, offsets);
+
+      for (size_t i = 0; i < runs.size(); i++) {
+        auto& r = runs[i];
+        UpdateTextureRec(screenshot_texture, { (float)r.x, (float)r.y, (float)r.width, (float)r.height }, scratch.data() + offsets[i]);
+        uploaded += (size_t)r.width * r.height;
+      }
+
+      LOG("Recapture uploaded %zu of %zu pixels\n", uploaded, (size_t)swidth() * sheight());
+    }
+
+    // Diff only needs hashes, previous pixels may be gone already
+    release_screenshot(screenshot_data);
+    screenshot_data = recaptured_data;
+    recaptured_data = nullptr;
+    tiles = std::move(recaptured_tiles);
+    edges = std::move(recaptured_edges);
+    windows = std::move(recaptured_windows);
+    hovered_window = nullptr;
+    redact_dirty = true;
+    cpu_copy_settled = false;
+    cpu_readback = false;
+    stats.reset(nullptr, 0);
+
+    if (diff_base) start_diff();
+
+    LOG("Recapture applied in %.2fms\n", (GetTime() - start) * 1000);
+    (void)start;
+
+    return this;
+  }
+
+  // Needs screenshot_data, call before the CPU copy is settled
+  State* start_diff() noexcept {
+    diff_ready = false;
+    diff_index = -1;
+
+    diff_job = jobs().submit([this]() {
+      diff = diff_frames(
+        diff_base, diff_base_size.first, diff_base_size.second,
+        screenshot_data, swidth(), sheight(),
+        options.diff_threshold
+      );
+    }, { diff_job });
+
+    return this;
+  }
+
+  State* poll_diff() noexcept {
+    if (!diff_job || !jobs().done(diff_job)) return this;
+    diff_job = nullptr;
+
+    if (!diff_base) return this;
+
+    Image mask = {
+      .data = diff.mask.data(),
+      .width = (int)diff.width,
+      .height = (int)diff.height,
+      .mipmaps = 1,
+      .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
+    };
+
+    if (diff_texture.id && diff_texture.width == mask.width && diff_texture.height == mask.height) {
+      UpdateTexture(diff_texture, mask.data);
+    } else {
+      if (diff_texture.id) UnloadTexture(diff_texture);
+      diff_texture = LoadTextureFromImage(mask);
+      track_gpu("diff mask", texture_bytes(mask.width, mask.height, mask.format));
+    }
+
+    if (!diff_shader.id) {
+      diff_shader = LoadShaderFromMemory(nullptr, DIFF_FRAGMENT_SHADER);
+      diff_time_loc = GetShaderLocation(diff_shader, "time");
+    }
+
+    LOG("diff: %zu pixels changed in %zu regions, %.2fms\n", diff.changed, diff.boxes.size(), diff.took_ms);
+    diff_ready = true;
+
+    return this;
+  }
+
+  // Current capture becomes the base, next F5 shows what changed since
+  State* store_diff_base() noexcept {
+    jobs().wait(diff_job);
+
+    if (!diff_base || diff_base_size != screen_size) {
+      release_screenshot(diff_base);
+      diff_base = capture_buffers().acquire((size_t)swidth() * sheight() * CAPTURE_BPP);
+      diff_base_size = screen_size;
+    }
+
+    if (!diff_base) return this;
+
+    // CPU copy may be released already, texture is the source of truth then (a compressed one keeps it)
+    if (screenshot_data) {
+      memcpy(diff_base, screenshot_data, (size_t)swidth() * sheight() * CAPTURE_BPP);
+    } else {
+      Image image = LoadImageFromTexture(screenshot_texture);
+      track_cpu(mem_cpu::CONVERSION, image_bytes(image));
+
+      memcpy(diff_base, image.data, (size_t)swidth() * sheight() * CAPTURE_BPP);
+
+      track_cpu(mem_cpu::CONVERSION, -(ssize_t)image_bytes(image));
+      UnloadImage(image);
+    }
+
+    diff_ready = false;
+    diff.boxes.clear();
+    diff_index = -1;
+
+    return this;
+  }
+
+  State* focus_diff_region(int step) noexcept {
+    if (!diff_ready || diff.boxes.empty()) return this;
+
+    int n = diff.boxes.size();
+    diff_index = diff_index < 0
+      ? (step > 0 ? 0 : n - 1)
+      : ((diff_index + step) % n + n) % n;
+
+    auto& b = diff.boxes[diff_index];
+
+    camera.offset = { GetScreenWidth() / 2.0f, GetScreenHeight() / 2.0f };
+    camera.target = { b.x + b.width / 2.0f, b.y + b.height / 2.0f };
+    camera.zoom = Clamp(fmin(GetScreenWidth() / (float)b.width, GetScreenHeight() / (float)b.height) * 0.5f, 0.3f, 100.0f);
+
+    return this;
+  }
+
+  State* draw_diff() noexcept {
+    if (!diff_ready) return this;
+
+    float time = GetTime();
+    SetShaderValue(diff_shader, diff_time_loc, &time, SHADER_UNIFORM_FLOAT);
+
+    BeginShaderMode(diff_shader);
+      DrawTexture(diff_texture, 0, 0, WHITE);
+    EndShaderMode();
+
+    for (int i = 0; i < (int)diff.boxes.size(); i++) {
+      auto& b = diff.boxes[i];
+      DrawRectangleLinesEx({ (float)b.x, (float)b.y, (float)b.width, (float)b.height }, (i == diff_index ? 3 : 1) / camera.zoom, i == diff_index ? YELLOW : RED);
+    }
+
+    return this;
+  }
+
+  State* draw_diff_status() noexcept {
+    if (!diff_ready) return this;
+
+    static char buffer[128];
+    snprintf(buffer, sizeof(buffer), "diff %d/%zu, %zu px changed (N/P)", diff_index + 1, diff.boxes.size(), diff.changed);
+
+    DrawRectangle(0, GetScreenHeight() - 32, MeasureTextEx(get_font(), buffer, 24, 1).x + 10, 32, {40, 40, 40, 150});
+    DrawTextEx(get_font(), buffer, {5, (float)GetScreenHeight() - 28}, 24, 1, YELLOW);
+
+    return this;
+  }
+
+  State* cycle_lens() noexcept {
+    lens = lens == Lens::OFF ? Lens::CIRCLE : lens == Lens::CIRCLE ? Lens::SQUARE : Lens::OFF;
+    return this;
+  }
+
+  // Redacted content must not show up magnified. Redrawn every frame while there are
+  // redactions, one blit of the capture. Call outside of drawing, after prepare_redaction().
+  State* prepare_lens() noexcept {
+    if (lens == Lens::OFF || redactions.empty()) return this;
+
+    const int w = screenshot_texture.width, h = screenshot_texture.height;
+
+    if (lens_texture.texture.width != w || lens_texture.texture.height != h) {
+      if (lens_texture.id) UnloadRenderTexture(lens_texture);
+      lens_texture = LoadRenderTexture(w, h);
+      track_gpu("lens redacted", render_texture_bytes(w, h));
+    }
+
+    BeginTextureMode(lens_texture);
+      DrawTexture(screenshot_texture, 0, 0, WHITE);
+      draw_redactions();
+    EndTextureMode();
+
+    return this;
+  }
+
+  // Screen space, magnification is on top of camera zoom
+  State* draw_lens() noexcept {
+    if (lens == Lens::OFF) return this;
+
+    if (!lens_shader.id) lens_shader = LoadShaderFromMemory(nullptr, LENS_FRAGMENT_SHADER);
+
+    const vec2 mouse = mouse_position();
+    const vec2 center = GetScreenToWorld2D(mouse, camera);
+    const float half = LENS_RADIUS / (camera.zoom * lens_zoom);
+    const float w = screenshot_texture.width, h = screenshot_texture.height;
+
+    Rectangle source = { center.x - half, center.y - half, 2 * half, 2 * half };
+    Rectangle dest = { mouse.x - LENS_RADIUS, mouse.y - LENS_RADIUS, 2 * LENS_RADIUS, 2 * LENS_RADIUS };
+
+    // Redacted composite is stored bottom up, the shader only cares where the source is
+    const bool redacted = lens_texture.id && !redactions.empty();
+    if (redacted) source.y = h - source.y - source.height;
+
+    float uv_source[4] = { source.x / w, source.y / h, source.width / w, source.height / h };
+    vec2 size = { w, h };
+    int circle = lens == Lens::CIRCLE, grid = lens_grid;
+
+    SetShaderValue(lens_shader, GetShaderLocation(lens_shader, "source"), uv_source, SHADER_UNIFORM_VEC4);
+    SetShaderValue(lens_shader, GetShaderLocation(lens_shader, "size"), &size, SHADER_UNIFORM_VEC2);
+    SetShaderValue(lens_shader, GetShaderLocation(lens_shader, "circle"), &circle, SHADER_UNIFORM_INT);
+    SetShaderValue(lens_shader, GetShaderLocation(lens_shader, "grid"), &grid, SHADER_UNIFORM_INT);
+
+    BeginShaderMode(lens_shader);
+      if (redacted) DrawTexturePro(lens_texture.texture, { source.x, source.y, source.width, -source.height }, dest, { 0, 0 }, 0, WHITE);
+      else DrawTexturePro(screenshot_texture, source, dest, { 0, 0 }, 0, WHITE);
+    EndShaderMode();
+
+    return this;
+  }
+
+  inline State* lap(Section section)
+  noexcept { if (profiler) profiler->lap((uint)section); return this; }
+
+  State* draw_frame_hud() noexcept {
+    if (!profiler || !profiler->enabled()) return this;
+
+    const uint rows = profiler->sections() + 3;
+    const vec2 origin = { 10, 130 };
+
+    DrawRectangle(origin.x, origin.y, 560, rows * 20 + 20, {40, 40, 40, 200});
+
+    static char buffer[128];
+    auto row = [&](uint i, Color color) {
+      DrawTextEx(get_font(), buffer, { origin.x + 10, origin.y + 10 + i * 20 }, 20, 1, color);
+    };
+
+    snprintf(buffer, sizeof(buffer), "%-11s %-20s %-20s", "ms", "cpu p50 p95 p99", "gpu p50 p95 p99");
+    row(0, GREEN);
+
+    for (uint i = 0; i <= profiler->sections(); i++) {
+      auto c = profiler->cpu(i), g = profiler->gpu(i);
+
+      snprintf(buffer, sizeof(buffer), "%-11s %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f",
+        i < profiler->sections() ? profiler->name(i) : "frame", c.p50, c.p95, c.p99, g.p50, g.p95, g.p99);
+      row(i + 1, i < profiler->sections() ? WHITE : GREEN);
+    }
+
+    // Present waits for vsync and the GPU, the rest is what the CPU has to do
+    auto work = profiler->cpu(profiler->sections()).p50 - profiler->cpu((uint)Section::PRESENT).p50;
+    auto gpu = profiler->gpu(profiler->sections()).p50;
+
+    snprintf(buffer, sizeof(buffer), "%s bound over %zu frames at zoom %.1f",
+      gpu > work ? "GPU" : "CPU", profiler->frames(), camera.zoom);
+    row(rows - 1, gpu > work ? ORANGE : SKYBLUE);
+
+    return this;
+  }
+
+  State* draw_stats_panel() noexcept {
+    if (!show_stats || reading_cpu_copy()) return this;
+
+    if (!stats.frame()) stats.reset(cpu_pixels(), swidth());
+    if (!stats.frame()) return this;
+
+    stats.update(selection_rect());
+
+    auto& h = stats.histogram();
+    auto r = stats.rect();
+
+    const float width = 256 + 20, bars = 96;
+    const vec2 origin = { GetScreenWidth() - width - 10, 10 };
+    const Color colors[3] = { {230, 60, 60, 160}, {60, 200, 60, 160}, {70, 110, 240, 160} };
+
+    DrawRectangle(origin.x, origin.y, width, bars + 20 + 5 * 22, {40, 40, 40, 200});
+
+    uint32_t peak = 1;
+    for (uint c = 0; c < 3; c++)
+      for (uint v = 0; v < 256; v++) peak = std::max(peak, h.bins[c][v]);
+
+    for (uint c = 0; c < 3; c++)
+      for (uint v = 0; v < 256; v++) {
+        float len = bars * h.bins[c][v] / peak;
+        if (len < 0.5f) continue;
+
+        float x = origin.x + 10 + v + 0.5f;
+        DrawLineV({ x, origin.y + 10 + bars }, { x, origin.y + 10 + bars - len }, colors[c]);
+      }
+
+    static char buffer[5][96];
+    snprintf(buffer[0], sizeof(buffer[0]), "%ux%u, %zu px", r.width, r.height, h.pixels);
+    snprintf(buffer[1], sizeof(buffer[1]), "mean %5.1f %5.1f %5.1f", h.mean(0), h.mean(1), h.mean(2));
+    snprintf(buffer[2], sizeof(buffer[2]), "min  #%02X%02X%02X", h.min(0), h.min(1), h.min(2));
+    snprintf(buffer[3], sizeof(buffer[3]), "max  #%02X%02X%02X", h.max(0), h.max(1), h.max(2));
+
+    auto p = GetScreenToWorld2D(mouse_position(), camera);
+    Color under = BLANK;
+
+    if (p.x >= 0 && p.y >= 0 && p.x < swidth() && p.y < sheight()) {
+      const u_char* px = stats.frame() + ((size_t)p.y * swidth() + (size_t)p.x) * CAPTURE_BPP;
+      under = { px[0], px[1], px[2], 255 };
+      snprintf(buffer[4], sizeof(buffer[4]), "(%u, %u) #%02X%02X%02X", (uint)p.x, (uint)p.y, px[0], px[1], px[2]);
+    } else {
+      snprintf(buffer[4], sizeof(buffer[4]), "-");
+    }
+
+    for (int i = 0; i < 5; i++)
+      DrawTextEx(get_font(), buffer[i], { origin.x + 10, origin.y + 20 + bars + i * 22 }, 20, 1, GREEN);
+
+    DrawRectangle(origin.x + width - 30, origin.y + 20 + bars + 4 * 22, 20, 20, under);
+
+    return this;
+  }
+
+  State* hover_window(vec2 p) noexcept {
+    hovered_window = jobs().done(windows_job) ? windows.at(p.x, p.y) : nullptr;
+    return this;
+  }
+
+  State* select_hovered_window() noexcept {
+    if (!hovered_window) return this;
+
+    auto& w = *hovered_window;
+    first_point = vec2{ (float)w.x, (float)w.y };
+    second_point = vec2{ (float)(w.x + w.width), (float)(w.y + w.height) };
+
+    return _recalc_min_max_points();
+  }
+
+  State* draw_hovered_window() noexcept {
+    if (!hovered_window) return this;
+
+    auto& w = *hovered_window;
+    Rectangle r = { (float)w.x, (float)w.y, (float)w.width, (float)w.height };
+
+    DrawRectangleRec(r, {0, 120, 255, 40});
+    DrawRectangleLinesEx(r, 2 / camera.zoom, SKYBLUE);
+
+    return this;
+  }
+
+  State* poll_recapture() noexcept {
+    switch (recapture) {
+      case Recapture::IDLE:
+        break;
+
+      case Recapture::HIDING:
+        if (GetTime() - recapture_started < RECAPTURE_HIDE_DELAY) break;
+
+        recaptured_history = -1;
+        recapture_job = jobs().submit([this]() {
+          recaptured_size = get_screen_size();
+          recaptured_data = take_screenshot(recaptured_size);
+          if (!recaptured_data) return;
+
+          if (history) history->add(recaptured_data, recaptured_size.first, recaptured_size.second, history_now());
+          recaptured_tiles = tile_grid(recaptured_size.first, recaptured_size.second, CAPTURE_BPP);
+          recaptured_tiles.compute(recaptured_data);
+          recaptured_edges = edge_index(recaptured_size.first, recaptured_size.second);
+          recaptured_edges.compute(recaptured_data);
+          recaptured_windows = window_index(list_windows(recaptured_size), recaptured_size.first, recaptured_size.second);
+        });
+
+        recapture = Recapture::CAPTURING;
+        break;
+
+      case Recapture::CAPTURING:
+        if (!jobs().done(recapture_job)) break;
+
+        recapture_job = nullptr;
+        if (recaptured_data) {
+          _apply_recapture();
+          history_index = recaptured_history;
+        }
+
+        if (IsWindowState(FLAG_WINDOW_HIDDEN)) ClearWindowState(FLAG_WINDOW_HIDDEN);
+        recapture = Recapture::IDLE;
+        break;
+    }
+
+    return this;
+  }
+
+  // Rebuilt frame goes in like a recapture, so only tiles that differ are uploaded. Windows
+  // are the ones of the newest capture, they rarely move within the history seconds.
+  State* scrub_history(int step) noexcept {
+    if (!history || recapture != Recapture::IDLE || reading_cpu_copy() || !jobs().done(windows_job)) return this;
+
+    const int count = history->frames();
+    const int current = history_index < 0 ? count - 1 : history_index;
+    const int index = std::clamp(current + step, 0, std::max(count - 1, 0));
+    if (count == 0 || index == current) return this;
+
+    recaptured_history = index == count - 1 ? -1 : index;
+    recapture_job = jobs().submit([this, index]() {
+      recaptured_data = history->rebuild(index, &recaptured_size);
+      if (!recaptured_data) return;
+
+      recaptured_tiles = tile_grid(recaptured_size.first, recaptured_size.second, CAPTURE_BPP);
+      recaptured_tiles.compute(recaptured_data);
+      recaptured_edges = edge_index(recaptured_size.first, recaptured_size.second);
+      recaptured_edges.compute(recaptured_data);
+      recaptured_windows = windows;
+    });
+
+    recapture = Recapture::CAPTURING;
+    return this;
+  }
+
+  // Frames of --history as ticks over their age, the one on screen highlighted
+  State* draw_history() noexcept {
+    if (!history) return this;
+
+    const auto times = history->times();
+    const size_t count = times.size();
+    if (count < 2) return this;
+
+    // Frames may have been evicted by an add() since history_index was set
+    const size_t shown = history_index < 0 ? count - 1 : std::min<size_t>(history_index, count - 1);
+    const double newest = times.back();
+    const double span = std::max(newest - times.front(), 1e-3);
+
+    const float width = GetScreenWidth() / 2.0f, x0 = GetScreenWidth() / 4.0f, y = GetScreenHeight() - 24.0f;
+
+    static char buffer[128];
+    snprintf(buffer, sizeof(buffer), "history %zu/%zu, %.1fs ago (,/. Shift by 10)", shown + 1, count, newest - times[shown]);
+
+    DrawRectangle(x0 - 10, y - 36, width + 20, 56, {40, 40, 40, 150});
+    DrawTextEx(get_font(), buffer, {x0, y - 32}, 24, 1, YELLOW);
+    DrawLineEx({ x0, y + 6 }, { x0 + width, y + 6 }, 1, GRAY);
+
+    for (size_t i = 0; i < count; i++) {
+      const float x = x0 + width * (1 - (newest - times[i]) / span);
+      DrawLineEx({ x, y }, { x, y + 12 }, i == shown ? 4 : 1, i == shown ? YELLOW : LIGHTGRAY);
+    }
+
+    return this;
+  }
+
+  // Output size of an export of width x height, kept within what a render texture can hold
+  pair<uint, uint> export_size(float width, float height) noexcept {
+    double w = options.export_width, h = options.export_height;
+
+    if (!w && !h) { w = width * options.export_scale; h = height * options.export_scale; }
+    else if (!h) h = w * height / width;
+    else if (!w) w = h * width / height;
+
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+    if (max_size > 0 && std::max(w, h) > max_size) {
+      double fit = max_size / std::max(w, h);
+      LOG("Export %.0fx%.0f is over %d, scaled down\n", w, h, max_size);
+      w *= fit;
+      h *= fit;
+    }
+
+    return { std::max<uint>(std::lround(w), 1), std::max<uint>(std::lround(h), 1) };
+  }
+
+  // Lossless capture pixels under the selection, resampled on the CPU when the export is
+  // scaled (GL filtering would only blur them), copied as they are otherwise
+  Texture2D _selection_texture(vec2 origin, float width, float height, uint out_width, uint out_height) noexcept {
+    const u_char* pixels = cpu_pixels();
+    u_char* out = capture_buffers().acquire((size_t)out_width * out_height * CAPTURE_BPP);
+
+    if (!pixels || !out) {
+      capture_buffers().release(out);
+      return {};
+    }
+
+    const size_t stride = (size_t)swidth() * CAPTURE_BPP;
+    const u_char* first = pixels + (size_t)origin.y * stride + (size_t)origin.x * CAPTURE_BPP;
+    bool ok = true;
+
+    if (out_width == (uint)width && out_height == (uint)height) {
+      for (uint y = 0; y < out_height; y++)
+        memcpy(out + (size_t)y * out_width * CAPTURE_BPP, first + y * stride, (size_t)out_width * CAPTURE_BPP);
+    } else {
+      [[maybe_unused]] auto start = GetTime();
+      ok = resample_rgba(first, width, height, stride, out, out_width, out_height, options.export_filter);
+      LOG("Resampled %.0fx%.0f to %ux%u in %.2fms\n", width, height, out_width, out_height, (GetTime() - start) * 1000);
+    }
+
+    Texture2D texture = {};
+    if (ok) {
+      texture = LoadTextureFromImage((Image){
+        .data = out,
+        .width = (int)out_width,
+        .height = (int)out_height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+      });
+      track_gpu("export selection", texture_bytes(texture.width, texture.height, texture.format));
+    }
+
+    capture_buffers().release(out);
+    return texture;
+  }
+
+  // Selection and annotations at export size into target, which is (re)created only when
+  // that size changes so batches of same sized images keep drawing into one
+  State* render_export(RenderTexture2D& target) noexcept {
+    auto screen_first_point = min_point.value_or(vec2{ 0, 0 });
+    auto screen_second_point = max_point.value_or(vec2{
+      static_cast<float>(swidth()),
+      static_cast<float>(sheight())
+    });
+
+    if (screen_first_point == screen_second_point) {
+      screen_first_point = {0, 0};
+      screen_second_point = {
+        static_cast<float>(swidth()),
+        static_cast<float>(sheight())
+      };
+    }
+
+    auto width = screen_second_point.x - screen_first_point.x;
+    auto height = screen_second_point.y - screen_first_point.y;
+
+    if (!redactions.empty()) prepare_redaction();
+
+    auto [out_width, out_height] = export_size(width, height);
+    Texture2D selection_texture = {};
+    if (out_width != (uint)width || out_height != (uint)height || lossy_texture())
+      selection_texture = _selection_texture(screen_first_point, width, height, out_width, out_height);
+
+    if (!target.id || target.texture.width != (int)out_width || target.texture.height != (int)out_height) {
+      if (target.id) UnloadRenderTexture(target);
+      target = LoadRenderTexture(out_width, out_height);
+      track_gpu("export target", render_texture_bytes(target.texture.width, target.texture.height));
+    }
+
+    // Render all objects into texture, callable between frames without an extra swap
+    BeginTextureMode(target);
+      if (selection_texture.id) DrawTextureRec(selection_texture, {
+        0,
+        0,
+        (float)out_width,
+        -(float)out_height,
+      }, {0, 0}, {255, 255, 255, 255});
+      // GL filtered when scaled, only without a CPU copy to resample
+      else DrawTexturePro(screenshot_texture, {
+        screen_first_point.x,
+        screen_first_point.y,
+        width,
+        -height,
+      }, {0, 0, (float)out_width, (float)out_height}, {0, 0}, 0, {255, 255, 255, 255});
+
+      // Annotations keep selection coordinates, the matrix rasterizes them at export size
+      rlPushMatrix();
+        rlScalef(out_width / width, out_height / height, 1);
+
+        int i = 0;
+        for (auto& r : redactions) {
+          if (i++ == redactions.size() - 1 && !check_tools(Tools::REDACT)) break;
+          if (!r.first.has_value() || !r.second.has_value()) break;
+
+          auto area = rect_from_vectors(*r.first, *r.second);
+          _draw_redaction(r, area, { area.x - screen_first_point.x, height - (area.y - screen_first_point.y) - area.height }, false);
+        }
+
+        i = 0;
+        for (auto& c : crosshairs) {
+          if (i++ == crosshairs.size() - 1 && !check_tools(Tools::CROSSHAIR)) break;
+          auto selection_pos = c - screen_first_point;
+
+          DrawCrosshair(
+            {
+              { 0,     height - selection_pos.y },
+              { width, height - selection_pos.y },
+            },
+            {
+              { selection_pos.x, 0},
+              { selection_pos.x, height },
+            }
+          );
+        }
+
+        i = 0;
+        for (auto& [f, s] : lines) {
+          if (i++ == lines.size() - 1 && !check_tools(Tools::LINE)) break;
+          auto f_ = *f - screen_first_point;
+          auto s_ = *s - screen_first_point;
+
+          DrawLineEx(
+            { f_.x, height - f_.y },
+            { s_.x, height - s_.y },
+            5,
+            MAGENTA
+          );
+        }
+
+        i = 0;
+        for (auto& [f, s] : rectangles) {
+          if (i++ == rectangles.size() - 1 && !check_tools(Tools::RECTANGLE)) break;
+          auto f_ = *f - screen_first_point;
+          auto s_ = *s - screen_first_point;
+
+          DrawRectangleRoundedLines(rect_from_vectors(
+            { f_.x, height - f_.y },
+            { s_.x, height - s_.y }
+          ), 0.05, 10, 5, MAGENTA);
+        }
+
+        i = 0;
+        for (auto& [f, s] : arrows) {
+          if (i++ == arrows.size() - 1 && !check_tools(Tools::ARROW)) break;
+          auto f_ = *f - screen_first_point;
+          auto s_ = *s - screen_first_point;
+          f_.y = height - f_.y;
+          s_.y = height - s_.y;
+
+          DrawArrow(pair<vec2, vec2>( f_, s_ ));
+        }
+
+        // Glyphs would come out upside down with mirrored positions, mirror the geometry instead
+        if (!texts.empty()) {
+          auto& font = get_sdf_font();
+
+          rlDisableBackfaceCulling();
+          rlPushMatrix();
+            rlTranslatef(-screen_first_point.x, height + screen_first_point.y, 0);
+            rlScalef(1, -1, 1);
+
+            BeginShaderMode(sdf_shader);
+              for (auto& t : texts)
+                DrawTextEx(font, t.text.c_str(), t.position, t.size, t.size / font.baseSize, MAGENTA);
+            EndShaderMode();
+          rlPopMatrix();
+          rlEnableBackfaceCulling();
+        }
+      rlPopMatrix();
+    EndTextureMode();
+
+    if (selection_texture.id) {
+      UnloadTexture(selection_texture);
+      track_gpu("export selection", 0);
+    }
+
+    return this;
+  }
+
+  Image render_screenshot_and_close() {
+    LOG("Begin load image from texture\n");
+
+    RenderTexture2D target = {};
+    render_export(target);
+
+    auto image = LoadImageFromTexture(target.texture);
+    UnloadRenderTexture(target);
+    track_gpu("export target", 0);
+
+    // Owned by whoever takes it, they uncount it when it's unloaded
+    track_cpu(mem_cpu::EXPORT, image_bytes(image));
+    return image;
+  }
+
+  static session_shape _to_shape(optional<vec2> first, optional<vec2> second, uint32_t flags = 0) noexcept {
+    if (first.has_value()) flags |= SESSION_FIRST;
+    if (second.has_value()) flags |= SESSION_SECOND;
+
+    return {
+      { first.value_or(vec2{}).x, first.value_or(vec2{}).y },
+      { second.value_or(vec2{}).x, second.value_or(vec2{}).y },
+      flags,
+    };
+  }
+
+  static pair<optional<vec2>, optional<vec2>> _from_shape(const session_shape& s) noexcept {
+    return {
+      s.flags & SESSION_FIRST ? optional(vec2{ s.first.x, s.first.y }) : nullopt,
+      s.flags & SESSION_SECOND ? optional(vec2{ s.second.x, s.second.y }) : nullopt,
+    };
+  }
+
+  // F2, reopened with --open without capturing
+  State* save_to_session() noexcept {
+    auto start = GetTime();
+
+    session s = { .width = swidth(), .height = sheight(), .pixels = (u_char*)cpu_pixels() };
+    if (!s.pixels) return this;
+
+    for (auto& c : crosshairs) s.crosshairs.push_back({ c.x, c.y });
+    for (auto& [f, l] : lines) s.lines.push_back(_to_shape(f, l));
+    for (auto& [f, l] : arrows) s.arrows.push_back(_to_shape(f, l));
+    for (auto& [f, l] : rectangles) s.rectangles.push_back(_to_shape(f, l));
+    for (auto& r : redactions) s.redactions.push_back(_to_shape(r.first, r.second, r.pixelate ? (uint32_t)SESSION_PIXELATE : 0u));
+
+    for (auto& t : texts) {
+      s.texts.push_back({ { t.position.x, t.position.y }, t.size, (uint32_t)s.strings.size(), (uint32_t)t.text.size() });
+      s.strings += t.text;
+    }
+
+    s.view = {
+      { camera.target.x, camera.target.y },
+      { camera.offset.x, camera.offset.y },
+      camera.zoom,
+      _to_shape(first_point, second_point),
+    };
+
+    bool saved = save_session(options.session_file, s, options.session_compress);
+    fprintf(stderr, "session: %s %s in %.1fms\n", saved ? "saved" : "can't save", options.session_file, (GetTime() - start) * 1000);
+
+    return this;
+  }
+
+  // Pixels are taken by screenshot_data, the rest is copied
+  State* apply_session(const session& s) noexcept {
+    for (auto& c : s.crosshairs) crosshairs.push_back({ c.x, c.y });
+    for (auto& l : s.lines) lines.push_back(_from_shape(l));
+    for (auto& a : s.arrows) arrows.push_back(_from_shape(a));
+    for (auto& r : s.rectangles) rectangles.push_back(_from_shape(r));
+
+    for (auto& r : s.redactions) {
+      auto [f, l] = _from_shape(r);
+      redactions.push_back({ f, l, (bool)(r.flags & SESSION_PIXELATE) });
+    }
+
+    for (auto& t : s.texts)
+      texts.push_back({ { t.position.x, t.position.y }, s.strings.substr(t.offset, t.length), t.size });
+
+    camera.target = { s.view.target.x, s.view.target.y };
+    camera.offset = { s.view.offset.x, s.view.offset.y };
+    camera.zoom = s.view.zoom > 0 ? s.view.zoom : 1;
+
+    // Selection from the file is kept within the capture like one made with the mouse
+    std::tie(first_point, second_point) = _from_shape(s.view.selection);
+    for (auto* p : { &first_point, &second_point }) {
+      if (!p->has_value()) continue;
+
+      if (std::isfinite((*p)->x) && std::isfinite((*p)->y)) _fix_bound_point(p);
+      else *p = nullopt;
+    }
+
+    if (first_point.has_value() && second_point.has_value()) _recalc_min_max_points();
+
+    return this;
+  }
+};
 
 static State* state = new State{};
-static bool raise = true;
 
-int main() {
-  state->screen_size = get_screen_size();
-  auto load_screenshot_thread = std::thread([]() { state->screenshot_data = take_screenshot(state->screen_size); });
-  std::thread export_thread;
+//+Bench
+  template <typename F>
+  static double best_of(int runs, F&& fn) noexcept {
+    double best = 1e9;
+
+    for (int i = 0; i < runs; i++) {
+      auto start = chrono::steady_clock::now();
+      fn();
+      best = std::min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
 
-  SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_WINDOW_UNDECORATED);
-  SetTargetFPS(80);
+    return best;
+  }
 
-#ifndef DEBUG
-  SetTraceLogLevel(LOG_ERROR);
-#endif
+  static void report_scaling(pair<uint, uint> screen_size) noexcept {
+    const uint width = screen_size.first, height = screen_size.second;
+    const uint threads = jobs().threads();
+
+    vector<uint> widths;
+    for (uint w = 1; w < threads; w *= 2) widths.push_back(w);
+    widths.push_back(threads);
+
+    auto* pixels = take_screenshot(screen_size);
+    tile_grid grid(width, height, CAPTURE_BPP);
+    tile_grid empty = {};
+    vector<u_char> scratch;
+    vector<size_t> offsets;
+
+    printf("Scaling on %ux%u, %u threads (best of 3, ms)\n", width, height, threads);
+    printf("%-8s %12s %12s %12s %12s %12s\n", "threads", "capture", "hash", "pack", "encode x4", "diff");
+
+    double base[5] = {};
+
+    for (auto w : widths) {
+      jobs().set_width(w);
+
+      double t[5] = {
+        best_of(3, [&]() { release_screenshot(take_screenshot(screen_size)); }),
+        best_of(3, [&]() { grid.compute(pixels); }),
+        best_of(3, [&]() { pack_rects(pixels, width, CAPTURE_BPP, grid.diff(empty), scratch, offsets); }),
+        best_of(3, [&]() {
+          jobs().parallel_for(0, 4, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+              char path[64];
+              snprintf(path, sizeof(path), "/tmp/__bench_scaling_%zu.png", i);
+
+              // Each encoder takes its own quarter of the screen
+              ExportImage((Image){
+                  .data = pixels + i * (height / 4) * width * CAPTURE_BPP,
+                  .width = (int)width,
+                  .height = (int)height / 4,
+                  .mipmaps = 1,
+                  .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+              }, path);
+            }
+          });
+        }),
+        best_of(3, [&]() { diff_frames(pixels, width, height, pixels, width, height, options.diff_threshold); }),
+      };
+
+      if (w == 1) copy(t, t + 5, base);
+
+      printf("%-8u", w);
+      for (int i = 0; i < 5; i++) printf(" %7.2f x%3.1f", t[i], base[i] / t[i]);
+      printf("\n");
+    }
+
+    jobs().set_width(threads);
+    release_screenshot(pixels);
+  }
+
+  // Simulated capture of a w x h screen, pixels only, no X server or GPU involved.
+  // Legacy: whole BGRA reply plus packed RGB copy kept for the session.
+  // Pooled: band replies converted into a pool buffer, released after upload.
+  static void measure_capture_rss(uint width, uint height, bool pooled) noexcept {
+    const size_t pixels = (size_t)width * height;
+    auto base = current_rss_kb();
+    size_t after = 0;
+
+    if (!pooled) {
+      auto* reply = (u_char*)malloc(pixels * 4);
+      memset(reply, 0x80, pixels * 4);
+
+      auto* data = new u_char[pixels * 3];
+      for (size_t i = 0; i < pixels; i++) {
+        data[i * 3 + 0] = reply[i * 4 + 2];
+        data[i * 3 + 1] = reply[i * 4 + 1];
+        data[i * 3 + 2] = reply[i * 4 + 0];
+      }
+
+      free(reply);
+      after = current_rss_kb();
+      delete[] data;
+    } else {
+      auto* data = capture_buffers().acquire(pixels * CAPTURE_BPP);
+      const size_t band = (size_t)width * 128;
+
+      for (size_t offset = 0; offset < pixels; offset += band) {
+        auto n = std::min(band, pixels - offset);
+        auto* reply = (u_char*)malloc(n * 4);
+        memset(reply, 0x80, n * 4);
+
+        bgra_to_rgba(reply, data + offset * CAPTURE_BPP, n);
+        free(reply);
+      }
+
+      release_screenshot(data);
+      after = current_rss_kb();
+    }
+
+    printf("%5ux%-5u %-7s peak %7.1f MiB, held after upload %7.1f MiB\n",
+      width, height, pooled ? "pooled" : "legacy",
+      (peak_rss_kb() - base) / 1024.0, (after - base) / 1024.0);
+  }
+
+  static void report_memory() noexcept {
+    const pair<uint, uint> sizes[] = { { 3840, 2160 }, { 7680, 4320 } };
+
+    for (auto [w, h] : sizes)
+      for (bool pooled : { false, true }) {
+        // Peak RSS only grows, every scenario gets a fresh process
+        fflush(stdout);
+        if (auto pid = fork(); pid == 0) {
+          measure_capture_rss(w, h, pooled);
+          fflush(stdout);
+          _exit(0);
+        } else if (pid > 0) {
+          waitpid(pid, nullptr, 0);
+        }
+      }
+  }
+
+  // Corpus of near identical shots: the capture with a moving cursor, a changing text line and clock
+  static void report_archive(pair<uint, uint> screen_size) noexcept {
+    const uint width = screen_size.first, height = screen_size.second;
+    const uint SHOTS = 32;
+
+    char root[] = "/tmp/__bench_archive_XXXXXX";
+    if (!mkdtemp(root)) return;
+
+    auto* capture = take_screenshot(screen_size);
+    auto* pixels = capture_buffers().acquire((size_t)width * height * CAPTURE_BPP);
+
+    auto scribble = [&](uint x, uint y, uint w, uint h, uint seed) {
+      for (uint row = y; row < min(y + h, height); row++)
+        for (uint col = x; col < min(x + w, width); col++)
+          pixels[((size_t)row * width + col) * CAPTURE_BPP + (col + seed) % 3] ^= 0x5A + seed;
+    };
+
+    size_t raw = 0, first = 0;
+    double ingest_ms = 0, restore_ms = 0;
+    vector<string> names;
+
+    {
+      tile_archive archive(root);
+
+      for (uint i = 0; i < SHOTS; i++) {
+        memcpy(pixels, capture, (size_t)width * height * CAPTURE_BPP);
+        scribble(width / 2 + i * 17, height / 3 + i * 9, 12, 20, i);
+        scribble(width / 8, height / 2, width / 3, 20, i);
+        scribble(width - 120, 4, 100, 20, i);
+
+        auto r = archive.ingest(pixels, width, height);
+        if (r.name.empty()) break;
+
+        names.push_back(r.name);
+        raw += r.raw_bytes;
+        ingest_ms += r.took_ms;
+        if (i == 0) first = r.stored_bytes;
+      }
+
+      for (auto& name : names) {
+        uint w, h;
+        auto start = GetTime();
+        release_screenshot(archive.restore(name, &w, &h));
+        restore_ms += (GetTime() - start) * 1000;
+      }
+
+      size_t disk = archive.disk_bytes();
+
+      printf("Archive of %zu shots %ux%u into %s\n", names.size(), width, height, root);
+      printf("raw %9.1f MiB, on disk %7.1f MiB (x%.1f), first shot %7.1f KiB, next ones %7.1f KiB each\n",
+        raw / 1048576.0, disk / 1048576.0, (double)raw / max<size_t>(disk, 1),
+        first / 1024.0, (disk - first) / 1024.0 / max<size_t>(names.size() - 1, 1));
+      printf("ingest %7.2f ms/shot %8.1f MiB/s, restore %7.2f ms/shot, %zu unique tiles\n",
+        ingest_ms / max<size_t>(names.size(), 1), raw / 1048576.0 / (ingest_ms / 1000),
+        restore_ms / max<size_t>(names.size(), 1), archive.unique_tiles());
+    }
+
+    for (auto& name : names) unlink((string(root) + "/manifests/" + name).c_str());
+    unlink((string(root) + "/tiles.pack").c_str());
+    unlink((string(root) + "/tiles.idx").c_str());
+    rmdir((string(root) + "/manifests").c_str());
+    rmdir(root);
+
+    release_screenshot(pixels);
+    release_screenshot(capture);
+  }
+
+  // Supersampled export: 4x of a 1080p region (or the whole capture when smaller), 1 thread and all
+  static void report_resample(pair<uint, uint> screen_size) noexcept {
+    const uint width = screen_size.first, height = screen_size.second;
+    const uint w = min(width, 1920u), h = min(height, 1080u);
+    const uint threads = jobs().threads();
+
+    auto* pixels = take_screenshot(screen_size);
+    auto* out = capture_buffers().acquire((size_t)w * 4 * h * 4 * CAPTURE_BPP);
+
+    printf("Resample %ux%u to %ux%u (best of 3, ms)\n", w, h, w * 4, h * 4);
+    printf("%-10s %12s %12s\n", "filter", "1 thread", "threads");
+
+    for (auto filter : { resample_filter::LANCZOS3, resample_filter::BICUBIC }) {
+      double t[2];
 
-  InitWindow(state->swidth(), state->sheight(), "boomer2");
-  BeginDrawing(); ClearBackground({0, 0, 0, 0}); EndDrawing();
+      for (uint pass = 0; pass < 2; pass++) {
+        jobs().set_width(pass ? threads : 1);
+        t[pass] = best_of(3, [&]() { resample_rgba(pixels, w, h, (size_t)width * CAPTURE_BPP, out, w * 4, h * 4, filter); });
+      }
 
-  font = LoadFont_Terminus();
+      printf("%-10s %12.2f %12.2f (%u, x%.1f)\n",
+        filter == resample_filter::LANCZOS3 ? "lanczos3" : "bicubic", t[0], t[1], threads, t[0] / t[1]);
+    }
 
-  load_screenshot_thread.join();
+    release_screenshot(out);
+    release_screenshot(pixels);
+  }
 
-  state->screenshot_texture = LoadTextureFromImage((Image){
-      .data = state->screenshot_data,
-      .width = (int)state->swidth(),
-      .height = (int)state->sheight(),
+  // Capture handed to a consumer thread SHOTS times: through a PNG file it loads back, then
+  // through a memfd it maps and reads once, raw and PNG encoded
+  static void report_handoff(pair<uint, uint> screen_size) noexcept {
+    const uint width = screen_size.first, height = screen_size.second;
+    const uint SHOTS = 8;
+    const size_t raw = (size_t)width * height * CAPTURE_BPP;
+
+    auto* pixels = take_screenshot(screen_size);
+    Image image = {
+      .data = pixels,
+      .width = (int)width,
+      .height = (int)height,
       .mipmaps = 1,
-      .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8,
+      .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+    auto report = [&](const char* label, double ms) {
+      printf("%-10s %8.2f ms/shot %9.1f MiB/s\n", label, ms / SHOTS, raw * SHOTS / 1048576.0 / (ms / 1000));
+    };
+
+    printf("Handoff of %u shots %ux%u\n", SHOTS, width, height);
+
+    report("png file", best_of(1, [&]() {
+      for (uint i = 0; i < SHOTS; i++) {
+        ExportImage(image, "/tmp/__bench_handoff.png");
+        UnloadImage(LoadImage("/tmp/__bench_handoff.png"));
+      }
+    }));
+    unlink("/tmp/__bench_handoff.png");
+
+    for (auto format : { handoff_format::RAW, handoff_format::PNG }) {
+      int pair_fds[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair_fds) != 0) break;
+
+      export_handoff sender(pair_fds[0], nullptr, format);
+      // Consumer reads every cache line, volatile keeps the reads
+      volatile uint64_t checksum = 0;
+
+      double ms = best_of(1, [&]() {
+        auto consumer = jobs().submit([&]() {
+          for (uint i = 0; i < SHOTS; i++) {
+            handoff_header header;
+            int fd = handoff_receive(pair_fds[1], &header);
+            if (fd < 0) break;
+
+            auto* map = (const u_char*)mmap(nullptr, header.offset + header.bytes, PROT_READ, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+              if (format == handoff_format::PNG) {
+                Image decoded = LoadImageFromMemory(".png", map + header.offset, header.bytes);
+                checksum = checksum + decoded.width;
+                UnloadImage(decoded);
+              } else {
+                for (size_t at = 0; at < header.bytes; at += 64) checksum = checksum + map[header.offset + at];
+              }
+              munmap((void*)map, header.offset + header.bytes);
+            }
+            close(fd);
+          }
+        });
+
+        for (uint i = 0; i < SHOTS; i++) sender.send(image, i + 1);
+        jobs().wait(consumer);
+      });
+
+      report(format == handoff_format::RAW ? "memfd raw" : "memfd png", ms);
+      close(pair_fds[0]);
+      close(pair_fds[1]);
+    }
+
+    release_screenshot(pixels);
+  }
+
+  // Frame time with the lens off, then on, GPU work included by finishing every frame
+  struct lens_bench {
+    static constexpr int FRAMES = 240;
+
+    int frame = 0;
+    double start = 0, off_ms = 0;
+
+    // True once both halves are measured
+    bool step(State* s) noexcept {
+      rlDrawRenderBatchActive();
+      glFinish();
+
+      double now = GetTime();
+
+      if (frame == 0) {
+        s->lens = State::Lens::OFF;
+        start = now;
+      } else if (frame == FRAMES) {
+        off_ms = (now - start) * 1000 / FRAMES;
+        s->lens = State::Lens::CIRCLE;
+        s->lens_grid = true;
+        start = now;
+      } else if (frame == 2 * FRAMES) {
+        double on_ms = (now - start) * 1000 / FRAMES;
+        printf("Lens on %ux%u: off %.3fms/frame, on %.3fms/frame (%+.3fms)\n", s->swidth(), s->sheight(), off_ms, on_ms, on_ms - off_ms);
+        return true;
+      }
+
+      frame++;
+      return false;
+    }
+  };
+//-Bench
+
+//+Batch
+  // --batch, every job image goes through the export path of a capture with its annotations
+  static int run_batch_file(const char* path) noexcept {
+    vector<batch_job> batch;
+    string error;
+
+    if (!load_batch(path, &batch, &error)) {
+      fprintf(stderr, "batch: %s\n", error.c_str());
+      return 1;
+    }
+
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+  #ifndef DEBUG
+    SetTraceLogLevel(LOG_ERROR);
+  #endif
+    InitWindow(64, 64, "boomer2");
+
+    RenderTexture2D target = {};
+    auto shape = [](const batch_shape& s) { return pair(optional(vec2{ s.x0, s.y0 }), optional(vec2{ s.x1, s.y1 })); };
+
+    auto stats = run_batch(batch, options.batch_depth, [&](const batch_job& job, const Image& image) -> const RenderTexture2D* {
+      auto& t = state->screenshot_texture;
+
+      if (t.id && t.width == image.width && t.height == image.height) UpdateTexture(t, image.data);
+      else {
+        if (t.id) UnloadTexture(t);
+        t = LoadTextureFromImage(image);
+      }
+
+      state->screen_size = { (uint)image.width, (uint)image.height };
+      state->screenshot_data = (u_char*)image.data;
+
+      state->crosshairs.clear();
+      state->lines.clear();
+      state->arrows.clear();
+      state->rectangles.clear();
+      state->texts.clear();
+
+      for (auto& c : job.crosshairs) state->crosshairs.push_back(c);
+      for (auto& l : job.lines) state->lines.push_back(shape(l));
+      for (auto& a : job.arrows) state->arrows.push_back(shape(a));
+      for (auto& r : job.rectangles) state->rectangles.push_back(shape(r));
+      for (auto& x : job.texts) state->texts.push_back({ { x.x, x.y }, x.text, x.size });
+
+      // With no tool active render_export skips the last shape of each kind, the one that
+      // would be being placed, as the overlay leaves an empty one there
+      state->crosshairs.push_back({});
+      state->lines.push_back({});
+      state->arrows.push_back({});
+      state->rectangles.push_back({});
+
+      state->min_point = nullopt;
+      state->max_point = nullopt;
+      state->reset_tools()->render_export(target);
+
+      // Image belongs to the batch and is gone after this call
+      state->screenshot_data = nullptr;
+      return t.id && target.id ? &target : nullptr;
+    });
+
+    if (target.id) UnloadRenderTexture(target);
+    if (state->screenshot_texture.id) UnloadTexture(state->screenshot_texture);
+    CloseWindow();
+
+    stats.report(stdout);
+    return stats.failed ? 1 : 0;
+  }
+//-Batch
+
+//+History
+  // --history, captures until a signal (blocked in every thread): true on SIGUSR1 to open the
+  // overlay, false on SIGTERM or SIGINT to stop recording
+  static bool record_history() noexcept {
+    sigset_t trigger;
+    sigemptyset(&trigger);
+    sigaddset(&trigger, SIGUSR1);
+    sigaddset(&trigger, SIGTERM);
+    sigaddset(&trigger, SIGINT);
+
+    const timespec interval = { options.history_interval / 1000, (long)(options.history_interval % 1000) * 1000000 };
+    const double start = history_now();
+    timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+
+    size_t captures = 0;
+    bool capture_warned = false, fit_warned = false;
+    int received;
+
+    do {
+      auto size = get_screen_size();
+      auto* pixels = take_screenshot(size);
+
+      if (!pixels) {
+        if (!capture_warned) fprintf(stderr, "history: can't take a %ux%u screenshot\n", size.first, size.second);
+        capture_warned = true;
+      } else if (!history->add(pixels, size.first, size.second, history_now()) && !fit_warned) {
+        fprintf(stderr, "history: a %ux%u frame doesn't fit into %u MiB\n", size.first, size.second, options.history_budget);
+        fit_warned = true;
+      }
+
+      release_screenshot(pixels);
+      captures++;
+      received = sigtimedwait(&trigger, nullptr, &interval);
+    } while (received != SIGUSR1 && received != SIGTERM && received != SIGINT);
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+    const double wall = history_now() - start;
+    const double cpu = (cpu_end.tv_sec - cpu_start.tv_sec) + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "history: %zu frames in %.1f of %u MiB, %zu captures over %.1fs at %.1f%% of a core\n",
+      history->frames(), history->used_bytes() / 1048576.0, options.history_budget, captures, wall, 100 * cpu / std::max(wall, 1e-3));
+
+    return received == SIGUSR1;
+  }
+//-History
+
+int main(int argc, char** argv) {
+  startup_graph startup;
+  options.parse(argc, argv);
+
+  // Video on stdout would be interleaved with the reports printed there
+  if (options.record_video && !strcmp(options.record_video, "-")) {
+    bool reports = options.startup_report || options.replay_input || options.latency_report;
+  #ifdef DEBUG
+    reports = true;
+  #endif
+
+    if (reports) {
+      fprintf(stderr, "record: can't stream to stdout with reports (or a DEBUG build) writing to it\n");
+      return 1;
+    }
+  }
+
+  // Before any worker thread exists, they inherit the mask
+  if (options.history) {
+    sigset_t trigger;
+    sigemptyset(&trigger);
+    sigaddset(&trigger, SIGUSR1);
+    sigaddset(&trigger, SIGTERM);
+    sigaddset(&trigger, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &trigger, nullptr);
+  }
+
+  auto archive = options.archive || options.archive_list || options.archive_restore
+    ? new tile_archive(options.archive_dir ? options.archive_dir : default_archive_dir())
+    : nullptr;
+
+  if (archive && !archive->ok()) {
+    fprintf(stderr, "archive: can't open %s\n", options.archive_dir ? options.archive_dir : default_archive_dir().c_str());
+    return 1;
+  }
+
+  if (options.archive_list) {
+    for (auto& e : archive->list()) printf("%s %5ux%-5u %6zu tiles\n", e.name.c_str(), e.width, e.height, e.tiles);
+    printf("%zu unique tiles, %.1f MiB on disk\n", archive->unique_tiles(), archive->disk_bytes() / 1048576.0);
+    return 0;
+  }
+
+  if (options.archive_restore) {
+    uint w, h;
+    auto* pixels = archive->restore(options.archive_restore, &w, &h);
+
+    bool restored = pixels && ExportImage((Image){
+        .data = pixels,
+        .width = (int)w,
+        .height = (int)h,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    }, options.archive_restore_path);
+
+    release_screenshot(pixels);
+    if (!restored) fprintf(stderr, "archive: can't restore %s\n", options.archive_restore);
+
+    return restored ? 0 : 1;
+  }
+
+  if (options.batch) return run_batch_file(options.batch);
+
+  if (options.history) {
+    history = new screen_history((size_t)options.history_budget << 20, options.history);
+
+    if (!history->ok()) {
+      fprintf(stderr, "history: can't map %u MiB\n", options.history_budget);
+      return 1;
+    }
+
+    if (!record_history()) {
+      delete history;
+      return 0;
+    }
+
+    // Overlay is killed by them as usual, only this thread takes them
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGTERM);
+    sigaddset(&stop, SIGINT);
+    pthread_sigmask(SIG_UNBLOCK, &stop, nullptr);
+  }
+
+  session opened;
+
+  auto screen = startup.run("screen_size", {}, [&opened]() {
+    if (options.open_session) {
+      if (!load_session(options.open_session, &opened)) return;
+
+      state->screenshot_data = opened.pixels;
+      state->screen_size = { opened.width, opened.height };
+    }
+    else if (options.diff_next) state->screenshot_data = load_rgba_file(options.diff_next, &state->screen_size);
+    else state->screen_size = get_screen_size();
+  });
+
+  if (options.open_session && !state->screenshot_data) {
+    fprintf(stderr, "session: can't open %s\n", options.open_session);
+    return 1;
+  }
+
+  if (options.diff_next && !state->screenshot_data) {
+    fprintf(stderr, "diff: can't load %s\n", options.diff_next);
+    return 1;
+  }
+
+  if (options.replay_input) {
+    input_replay = new input_reader(options.replay_input);
+
+    if (!input_replay->ok()) {
+      fprintf(stderr, "input: can't replay %s\n", options.replay_input);
+      return 1;
+    }
+  }
+
+  if (options.bench_memory) {
+    report_memory();
+    return 0;
+  }
+
+  if (options.bench_scaling) {
+    report_scaling(state->screen_size);
+    return 0;
+  }
+
+  if (options.bench_archive) {
+    report_archive(state->screen_size);
+    return 0;
+  }
+
+  if (options.bench_resample) {
+    report_resample(state->screen_size);
+    return 0;
+  }
+
+  if (options.bench_handoff) {
+    report_handoff(state->screen_size);
+    return 0;
+  }
+
+  // Capture and window tree go out before our window is mapped
+  if (!options.diff_next && !options.open_session) {
+    auto tree = startup.submit("window_tree", { screen }, []() {
+      state->windows = window_index(list_windows(state->screen_size), state->swidth(), state->sheight());
+    });
+    state->windows_job = startup.job(tree);
+  }
+
+  auto capture = startup.submit("capture", { screen }, []() {
+    if (!state->screenshot_data) state->screenshot_data = take_screenshot(state->screen_size);
+  });
+
+  if (options.diff_base) {
+    auto diff = startup.submit("diff", { capture }, []() {
+      state->diff_base = load_rgba_file(options.diff_base, &state->diff_base_size);
+
+      if (state->diff_base && state->screenshot_data) state->diff = diff_frames(
+        state->diff_base, state->diff_base_size.first, state->diff_base_size.second,
+        state->screenshot_data, state->swidth(), state->sheight(),
+        options.diff_threshold
+      );
+      else if (!state->diff_base) fprintf(stderr, "diff: can't load %s\n", options.diff_base);
+    });
+    state->diff_job = startup.job(diff);
+  }
+
+  // Hashes are needed only by recapture, overlap them with window creation and upload
+  auto hash = startup.submit("tile_hash", { capture }, []() {
+    state->tiles = tile_grid(state->swidth(), state->sheight(), CAPTURE_BPP);
+    if (state->screenshot_data) state->tiles.compute(state->screenshot_data);
+  });
+
+  // Newest frame of the history is what the overlay opened on, read while the CPU copy is kept for hashing
+  state->hash_job = !history ? startup.job(hash) : jobs().submit([]() {
+    history->add(state->screenshot_data, state->swidth(), state->sheight(), history_now());
+  }, { startup.job(hash) });
+
+  // Selection snapping, not needed before the first right drag
+  auto edge_node = startup.submit("edge_index", { capture }, []() {
+    state->edges = edge_index(state->swidth(), state->sheight());
+    if (state->screenshot_data) state->edges.compute(state->screenshot_data);
+  });
+  state->edges_job = startup.job(edge_node);
+
+#ifdef DEBUG
+  // Debug overlay draws text from the first frame
+  auto font_node = startup.add("font_inflate");
+  startup.start(font_node);
+  prefetch_font();
+  auto font_done = jobs().submit([&startup, font_node]() { startup.finish(font_node); }, { font_inflate });
+#endif
+
+  auto handoff = options.out_fd >= 0 || options.out_socket
+    ? new export_handoff(options.out_fd, options.out_socket, options.out_format)
+    : nullptr;
+
+  auto exporter = new export_pool(options.session ? default_export_workers() : 1, 8, archive, handoff);
+  auto animation = options.anim ? new anim_encoder(options.anim, options.anim_delay) : nullptr;
+  optional<pair<Image, string>> pending_export = nullopt;
+
+  auto window = startup.run("window", { screen }, []() {
+    SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_WINDOW_UNDECORATED);
+    SetTargetFPS(options.bench_lens || options.replay_input ? 0 : 80);
+
+  #ifndef DEBUG
+    SetTraceLogLevel(LOG_ERROR);
+  #endif
+
+    InitWindow(state->swidth(), state->sheight(), "boomer2");
+  });
+
+  auto capture_wait = startup.run("capture_wait", { window, capture }, []() {});
+
+  if (!state->screenshot_data) {
+    fprintf(stderr, "capture: can't take a %ux%u screenshot\n", state->swidth(), state->sheight());
+    jobs().wait(state->hash_job);
+    jobs().wait(state->edges_job);
+    jobs().wait(state->diff_job);
+    CloseWindow();
+    return 1;
+  }
+
+  auto upload = startup.run("upload", { capture_wait }, []() {
+    state->screenshot_texture = state->load_screenshot_texture(state->screenshot_data);
+    state->track_screenshot_texture();
   });
 
+  auto video = options.record_video
+    ? new recorder(options.record_video, GetRenderWidth(), GetRenderHeight(), 80)
+    : nullptr;
+
+  if (video && !video->ok()) {
+    delete video;
+    video = nullptr;
+  }
+
+  lens_bench bench_lens;
+
+  // Mouse positions are only comparable in a window of the recorded size
+  if (input_replay && (input_replay->width != (uint)GetScreenWidth() || input_replay->height != (uint)GetScreenHeight()))
+    fprintf(stderr, "input: %s was recorded in a %ux%u window, replaying in %dx%d\n",
+      options.replay_input, input_replay->width, input_replay->height, GetScreenWidth(), GetScreenHeight());
+
+  if (options.record_input) {
+    input_recording = new input_writer(options.record_input, GetScreenWidth(), GetScreenHeight());
+    if (!input_recording->ok()) fprintf(stderr, "input: can't record into %s\n", options.record_input);
+  }
+
+  auto first_frame = startup.add("first_frame", { upload });
+  startup.start(first_frame);
+
   state->camera.zoom = 1.0;
+  if (options.open_session) state->apply_session(opened);
+
+  // Replay measures every frame from input to swap, GPU side through timer queries
+  auto replay_gpu = input_replay ? new gpu_timer() : nullptr;
+  frame_times replay_cpu_ms, replay_gpu_ms;
+
+  // Replayed input has no X events behind it
+  if ((options.low_latency || options.latency_report) && !input_replay) pointer = new pointer_latch((unsigned long)(uintptr_t)GetWindowHandle());
+  auto latency = options.latency_report && pointer ? new present_latency() : nullptr;
+
+  optional<vec2> prevMousePos = nullopt;
+  profiler = new frame_profiler({
+    "input", "update", "texture", "redactions", "diff", "tools",
+    "shading", "selection", "crosshairs", "lines", "arrows", "rectangles", "texts", "window",
+    "lens", "overlays", "present",
+  });
 
-  vec2 prevMousePos = GetMousePosition();
+  // Q with --history, the overlay closes and recording isn't restarted
+  bool stop_history = false;
 
   SetMouseCursor(MOUSE_CURSOR_CROSSHAIR);
   while (!WindowShouldClose()) {
-    auto thisPos = GetMousePosition();
-    auto wheel   = GetMouseWheelMove();
+    double frame_start = GetTime();
+    profiler->begin();
+
+    if (!poll_input()) break;
+
+    // Events up to raylib's poll, anything newer is late latched
+    pointer_moved = false;
+    latch_pointer();
+    if (replay_gpu) replay_gpu->begin();
+
+    // Stays set for the frame that commits the note, its Enter isn't an export
+    typing = state->editing_text.has_value();
+    state->update_text();
+
+    auto thisPos = mouse_position();
+    auto wheel   = mouse_wheel();
 
     if (wheel != 0) {
-      vec2 mouseWorldPos = GetScreenToWorld2D(GetMousePosition(), state->camera);
+      vec2 mouseWorldPos = GetScreenToWorld2D(mouse_position(), state->camera);
 
-      state->camera.offset = GetMousePosition();
+      state->camera.offset = mouse_position();
       state->camera.target = mouseWorldPos;
 
       state->camera.zoom += wheel * log(state->camera.zoom + 0.9);
@@ -663,44 +2922,95 @@ int main() {
       if (state->camera.zoom >= 100) state->camera.zoom = 100.0f;
     }
 
-    vec2 delta = prevMousePos - thisPos;
+    vec2 delta = prevMousePos.value_or(thisPos) - thisPos;
     prevMousePos = thisPos;
 
-    if (IsMouseButtonDown(0)) {
+    if (mouse_down(0) && !hotkey_down(KEY_W)) {
       SetMouseCursor(MOUSE_CURSOR_RESIZE_ALL);
       state->camera.target = GetScreenToWorld2D(state->camera.offset + delta, state->camera);
     } else {
       SetMouseCursor(MOUSE_CURSOR_CROSSHAIR);
     }
 
-    if (IsKeyPressed(KEY_ESCAPE)) {
+    state->lap(Section::INPUT);
+
+    if (hotkey_pressed(KEY_ESCAPE)) {
       state->reset_tools();
     }
 
+    // Upload is done, CPU copy is released once hashing and diffing stop reading it
+    if (!state->cpu_copy_settled && !state->reading_cpu_copy()) {
+      state->settle_cpu_copy();
+      state->cpu_copy_settled = true;
+    }
+
+    if (state->cpu_copy_settled) state->drop_cpu_readback();
+
+    if (hotkey_pressed(KEY_F5)) state->begin_recapture();
+    state->poll_recapture();
+
+    if (hotkey_pressed(KEY_B)) {
+      state->redact_pixelate = !state->redact_pixelate;
+      if (state->check_tools(Tools::REDACT) && !state->redactions.empty()) state->redactions.back().pixelate = state->redact_pixelate;
+    }
+
+    if (hotkey_down(KEY_X) || !state->redactions.empty()) state->prepare_redaction();
+
+    if (hotkey_pressed(KEY_L)) state->cycle_lens();
+    if (hotkey_pressed(KEY_G)) state->lens_grid = !state->lens_grid;
+    if (hotkey_pressed(KEY_LEFT_BRACKET))  state->lens_zoom = fmax(LENS_MIN_ZOOM, state->lens_zoom / 2);
+    if (hotkey_pressed(KEY_RIGHT_BRACKET)) state->lens_zoom = fmin(LENS_MAX_ZOOM, state->lens_zoom * 2);
+
+    if (hotkey_pressed(KEY_T)) state->begin_text(GetScreenToWorld2D(mouse_position(), state->camera));
+    if (hotkey_pressed(KEY_BACKSPACE)) state->remove_text();
+
+    if (hotkey_pressed(KEY_H)) state->show_stats = !state->show_stats;
+    if (hotkey_pressed(KEY_E)) state->snap = !state->snap;
+    if (hotkey_pressed(KEY_F6)) state->store_diff_base();
+    if (hotkey_pressed(KEY_F2)) state->save_to_session();
+    if (hotkey_pressed(KEY_F3)) profiler->enable(!profiler->enabled());
+    if (hotkey_pressed(KEY_N)) state->focus_diff_region(1);
+    if (hotkey_pressed(KEY_P)) state->focus_diff_region(-1);
+    if (history && hotkey_pressed(KEY_Q)) {
+      stop_history = true;
+      break;
+    }
+
+    if (hotkey_pressed(KEY_COMMA))  state->scrub_history(key_down(KEY_LEFT_SHIFT) ? -10 : -1);
+    if (hotkey_pressed(KEY_PERIOD)) state->scrub_history(key_down(KEY_LEFT_SHIFT) ? 10 : 1);
+    state->poll_diff();
+
     // Tools::CROSSHAIR
-      if (IsKeyDown( KEY_F )) {
+      if (hotkey_down( KEY_F )) {
         state->activate_tools(Tools::CROSSHAIR);
-        if (IsMouseButtonPressed(0)) state->add_new_crosshair();
-        if (IsMouseButtonPressed(1)) state->remove_crosshair();
+        if (mouse_pressed(0)) state->add_new_crosshair();
+        if (mouse_pressed(1)) state->remove_crosshair();
       } else { state->deactivate_tools(Tools::CROSSHAIR); }
 
-    if (IsKeyPressed(KEY_ENTER) || (IsKeyDown(KEY_C) && !IsKeyDown(KEY_LEFT_SHIFT)) || __BENCH) {
-      auto image = state->render_screenshot_and_close();
-
-      export_thread = std::thread([image]() {
-        if (ExportImage(image, "/tmp/__out_image.png")) {
-          if (system("xclip -selection clipboard -t image/png -i /tmp/__out_image.png") != 0) {
-            LOG("xclip failed");
-            assert(false);
-          }
+    if (animation) {
+      if (hotkey_pressed(KEY_ENTER) || (hotkey_pressed(KEY_C) && !key_down(KEY_LEFT_SHIFT)))
+        animation->add_frame(state->render_screenshot_and_close());
+    } else if (options.session) {
+      // Queue is full, retry handover next frame instead of blocking the loop
+      if (pending_export.has_value() && exporter->try_submit(pending_export->first, pending_export->second, true))
+        pending_export = nullopt;
 
-          UnloadImage(image);
-        }
-      });
+      if ((hotkey_pressed(KEY_ENTER) || (hotkey_pressed(KEY_C) && !key_down(KEY_LEFT_SHIFT))) && !pending_export.has_value()) {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/__out_image_%03u.png", exporter->submitted() + 1);
 
+        auto image = state->render_screenshot_and_close();
+        if (!exporter->try_submit(image, path, true)) pending_export = pair(image, string(path));
+      }
+    } else if (hotkey_pressed(KEY_ENTER) || (hotkey_down(KEY_C) && !key_down(KEY_LEFT_SHIFT)) || (__BENCH && !options.bench_lens)) {
+      exporter->try_submit(state->render_screenshot_and_close(), "/tmp/__out_image.png", true);
       goto close;
     }
 
+    set_cpu(mem_cpu::ANNOTATIONS, state->annotation_bytes());
+    state->prepare_lens();
+    state->lap(Section::UPDATE);
+
     // raise_window(true);
     BeginDrawing();
       ClearBackground((Color){0, 42, 90, 255});
@@ -708,7 +3018,14 @@ int main() {
       BeginMode2D(state->camera);
         DrawTexture(state->screenshot_texture, 0, 0, WHITE);
 
-        if (IsKeyPressed(KEY_TAB) && state->min_point.has_value() && state->max_point.has_value()) {
+        state
+          ->lap(Section::TEXTURE)
+          ->draw_redactions()
+          ->lap(Section::REDACTIONS)
+          ->draw_diff()
+          ->lap(Section::DIFF);
+
+        if (hotkey_pressed(KEY_TAB) && state->min_point.has_value() && state->max_point.has_value()) {
           auto max_point = state->max_point.value();
           auto min_point = state->min_point.value();
 
@@ -719,7 +3036,7 @@ int main() {
           SetWindowSize((int)width, (int)height);
         }
 
-        if (IsMouseButtonDown(1) && IsKeyUp(KEY_LEFT_SHIFT)) {
+        if (mouse_down(1) && !key_down(KEY_LEFT_SHIFT)) {
           if (!state->select_area_in_progress) state->first_point = nullopt;
           if (!state->first_point.has_value()) state->set_first_point(GetScreenToWorld2D(thisPos, state->camera));
 
@@ -733,84 +3050,254 @@ int main() {
           state->update_last_crosshair(GetScreenToWorld2D(thisPos, state->camera));
         }
 
+        // Hold W to pick a window, left click selects its bounds
+          if (hotkey_down( KEY_W )) {
+            state->hover_window(GetScreenToWorld2D(thisPos, state->camera));
+            if (mouse_pressed(0)) state->select_hovered_window();
+          } else { state->hovered_window = nullptr; }
+
         // Tools::LINE
-          if (IsKeyDown( KEY_S ) && !(state->check_tools(Tools::LINE))) {
+          if (hotkey_down( KEY_S ) && !(state->check_tools(Tools::LINE))) {
             state->activate_tools(Tools::LINE);
             state->update_last_line_first_point(GetScreenToWorld2D(thisPos, state->camera));
           }
 
-          if (IsKeyUp( KEY_S ) && state->check_tools(Tools::LINE)) state->deactivate_tools(Tools::LINE);
+          if (!hotkey_down( KEY_S ) && state->check_tools(Tools::LINE)) state->deactivate_tools(Tools::LINE);
 
           if (state->check_tools(Tools::LINE)) {
             state->update_last_line_second_point(GetScreenToWorld2D(thisPos, state->camera));
 
-            if (IsMouseButtonPressed(0)) {
+            if (mouse_pressed(0)) {
               state->add_new_line();
               state->deactivate_tools(Tools::LINE);
             }
 
-            if (IsMouseButtonPressed(1)) state->remove_line();
+            if (mouse_pressed(1)) state->remove_line();
           }
 
         // Tools::ARROW
-          if (IsKeyDown( KEY_A ) && !(state->check_tools(Tools::ARROW))) {
+          if (hotkey_down( KEY_A ) && !(state->check_tools(Tools::ARROW))) {
             state->activate_tools(Tools::ARROW);
             state->update_last_arrow_first_point(GetScreenToWorld2D(thisPos, state->camera));
           }
 
-          if (IsKeyUp( KEY_A ) && state->check_tools(Tools::ARROW)) state->deactivate_tools(Tools::ARROW);
+          if (!hotkey_down( KEY_A ) && state->check_tools(Tools::ARROW)) state->deactivate_tools(Tools::ARROW);
 
           if (state->check_tools(Tools::ARROW)) {
             state->update_last_arrow_second_point(GetScreenToWorld2D(thisPos, state->camera));
 
-            if (IsMouseButtonPressed(0)) {
+            if (mouse_pressed(0)) {
               state->add_new_arrow();
               state->deactivate_tools(Tools::ARROW);
             }
 
-            if (IsMouseButtonPressed(1)) state->remove_arrow();
+            if (mouse_pressed(1)) state->remove_arrow();
+          }
+
+        // Tools::REDACT
+          if (hotkey_down( KEY_X ) && !(state->check_tools(Tools::REDACT))) {
+            state->activate_tools(Tools::REDACT);
+            state->update_last_redaction_first_point(GetScreenToWorld2D(thisPos, state->camera));
+          }
+
+          if (!hotkey_down( KEY_X ) && state->check_tools(Tools::REDACT)) state->deactivate_tools(Tools::REDACT);
+
+          if (state->check_tools(Tools::REDACT)) {
+            state->update_last_redaction_second_point(GetScreenToWorld2D(thisPos, state->camera));
+
+            if (mouse_pressed(0)) {
+              state->add_new_redaction();
+              state->deactivate_tools(Tools::REDACT);
+            }
+
+            if (mouse_pressed(1)) state->remove_redaction();
           }
 
         // Tools::RECTANGLE
-          if (IsKeyDown( KEY_R ) && !(state->check_tools(Tools::RECTANGLE))) {
+          if (hotkey_down( KEY_R ) && !(state->check_tools(Tools::RECTANGLE))) {
             state->activate_tools(Tools::RECTANGLE);
             LOG("Update first rect point before: " FF "\n", F(GetScreenToWorld2D(thisPos, state->camera)));
             state->update_last_rectangle_first_point(GetScreenToWorld2D(thisPos, state->camera));
           }
 
-          if (IsKeyUp( KEY_R ) && state->check_tools(Tools::RECTANGLE)) state->deactivate_tools(Tools::RECTANGLE);
+          if (!hotkey_down( KEY_R ) && state->check_tools(Tools::RECTANGLE)) state->deactivate_tools(Tools::RECTANGLE);
 
           if (state->check_tools(Tools::RECTANGLE)) {
             LOG("Update last rect point before: " FF "\n", F(GetScreenToWorld2D(thisPos, state->camera)));
             state->update_last_rectangle_second_point(GetScreenToWorld2D(thisPos, state->camera));
 
-            if (IsMouseButtonPressed(0)) {
+            if (mouse_pressed(0)) {
               state->add_new_rectangle();
               state->deactivate_tools(Tools::RECTANGLE);
             }
 
-            if (IsMouseButtonPressed(1)) state->remove_rectangle();
+            if (mouse_pressed(1)) state->remove_rectangle();
           }
 
         state
+          ->lap(Section::TOOLS)
+          ->late_latch()
           ->draw_shading()
+          ->lap(Section::SHADING)
           ->draw_selection_box()
+          ->lap(Section::SELECTION)
           ->draw_crosshairs()
+          ->lap(Section::CROSSHAIRS)
           ->draw_lines()
+          ->lap(Section::LINES)
           ->draw_arrows()
-          ->draw_rectangles();
+          ->lap(Section::ARROWS)
+          ->draw_rectangles()
+          ->lap(Section::RECTANGLES)
+          ->draw_texts()
+          ->lap(Section::TEXTS)
+          ->draw_hovered_window()
+          ->lap(Section::WINDOW);
       EndMode2D();
 
+      state
+        ->draw_lens()
+        ->lap(Section::LENS);
+
     #ifdef DEBUG
       state->draw_debug_line();
       state->draw_tool_pallete();
     #endif
+
+      state
+        ->draw_diff_status()
+        ->draw_history()
+        ->draw_stats_panel()
+        ->draw_frame_hud()
+        ->lap(Section::OVERLAYS);
+
+      if (video) video->capture_frame();
+
+      if (replay_gpu) {
+        replay_gpu->end();
+        replay_cpu_ms.add((GetTime() - frame_start) * 1000);
+
+        for (double ms; replay_gpu->result(&ms);) replay_gpu_ms.add(ms);
+      }
     EndDrawing();
+
+    // Swap doesn't wait for the GPU, without this frames queue up behind the one on screen
+    if (options.low_latency) glFinish();
+    if (latency && pointer_moved) latency->presented(pointer_last.time);
+
+    state->lap(Section::PRESENT);
+
+    if (first_frame >= 0) {
+      startup.finish(first_frame);
+
+    #ifdef DEBUG
+      jobs().wait(font_done);
+      options.startup_report = true;
+    #endif
+
+      if (options.startup_report) startup.report(stdout, first_frame);
+      first_frame = -1;
+    }
+
+    if (options.bench_lens && bench_lens.step(state)) goto close;
   }
 
 close:
+  // The pool was full when it was taken, still the user asked for it
+  if (pending_export.has_value()) exporter->submit(pending_export->first, pending_export->second, true);
+
+  if (replay_gpu) {
+    for (double ms; replay_gpu->result(&ms, true);) replay_gpu_ms.add(ms);
+    delete replay_gpu;
+
+    printf("Replay of %s, %zu of %zu frames drawn\n", options.replay_input, replay_cpu_ms.samples.size(), input_replay->frames());
+    replay_cpu_ms.report(stdout, "cpu");
+    replay_gpu_ms.report(stdout, "gpu");
+  }
+
+  if (latency) {
+    latency->finish();
+    printf("Input to present, %s\n", options.low_latency ? "low latency" : "default");
+    latency->samples.report(stdout, "lat");
+    delete latency;
+  }
+
+  delete pointer;
+  delete input_replay;
+  delete input_recording;
+  delete profiler;
+  profiler = nullptr;
+
+  jobs().wait(state->recapture_job);
+  jobs().wait(state->hash_job);
+  jobs().wait(state->edges_job);
+  jobs().wait(state->windows_job);
+  jobs().wait(state->diff_job);
+  jobs().wait(font_inflate);
+
+  // Glyph tables are static, only the atlas is ours
+  if (font_cache.has_value()) UnloadTexture(font_cache->texture);
+  else if (font_pixels) MemFree(font_pixels);
+  track_gpu("font", 0);
+
+  if (sdf_font_cache.has_value()) {
+    UnloadTexture(sdf_font_cache->texture);
+    UnloadShader(sdf_shader);
+    track_gpu("sdf font", 0);
+  }
+  release_screenshot(state->recaptured_data);
+  release_screenshot(state->diff_base);
+
+  if (state->diff_texture.id) UnloadTexture(state->diff_texture);
+  if (state->diff_shader.id) UnloadShader(state->diff_shader);
+  if (state->redact_texture.id) UnloadRenderTexture(state->redact_texture);
+  track_gpu("diff mask", 0);
+  track_gpu("redaction blur", 0);
+  if (state->blur_shader.id) UnloadShader(state->blur_shader);
+  if (state->pixelate_shader.id) UnloadShader(state->pixelate_shader);
+  if (state->lens_shader.id) UnloadShader(state->lens_shader);
+  if (state->lens_texture.id) UnloadRenderTexture(state->lens_texture);
+  track_gpu("lens redacted", 0);
+
+  if (animation) {
+    if (!animation->finish()) fprintf(stderr, "anim: nothing written into %s\n", options.anim);
+    animation->report(stderr);
+    delete animation;
+  }
+
+  if (video) {
+    video->finish();
+    video->report(stderr);
+    delete video;
+  }
+
   UnloadTexture(state->screenshot_texture);
-  delete[] state->screenshot_data;
+  state->screenshot_texture = {};
+  state->track_screenshot_texture();
+
+  release_screenshot(state->screenshot_data);
   CloseWindow();
-  if (export_thread.joinable()) export_thread.join();
+
+  // Drains queued exports before exit
+  delete exporter;
+  delete handoff;
+  delete archive;
+  delete history;
+
+  // Anything still live here outlives everything that should own it
+  if (options.memory_json) {
+    if (FILE* out = fopen(options.memory_json, "w")) {
+      write_memory_json(out, state->swidth(), state->sheight());
+      fclose(out);
+    } else {
+      fprintf(stderr, "memory: can't write %s\n", options.memory_json);
+    }
+  }
+
+  // Back to recording, a fresh process is simpler than resetting every bit of overlay state
+  if (options.history && !stop_history) {
+    execv("/proc/self/exe", argv);
+    perror("history: can't restart");
+    return 1;
+  }
 }
@@ -0,0 +1,108 @@
+#include "memory.h"
+#include "buffers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <raylib.h>
+
+struct counter {
+  std::atomic<size_t> live = 0;
+  std::atomic<size_t> peak = 0;
+
+  void set(size_t bytes) noexcept {
+    live = bytes;
+
+    size_t p = peak.load(std::memory_order_relaxed);
+    while (bytes > p && !peak.compare_exchange_weak(p, bytes)) {}
+  }
+
+  void add(ssize_t delta) noexcept {
+    size_t now = live.fetch_add(delta) + delta;
+
+    size_t p = peak.load(std::memory_order_relaxed);
+    while (now > p && !peak.compare_exchange_weak(p, now)) {}
+  }
+};
+
+static counter cpu[(uint)mem_cpu::COUNT];
+
+static std::mutex gpu_mutex;
+static std::vector<std::pair<std::string, mem_usage>> gpu_resources;
+static mem_usage gpu_total = {};
+
+const char* mem_cpu_name(mem_cpu subsystem) noexcept {
+  switch (subsystem) {
+    case mem_cpu::CAPTURE:     return "capture";
+    case mem_cpu::CONVERSION:  return "conversion";
+    case mem_cpu::ANNOTATIONS: return "annotations";
+    case mem_cpu::EXPORT:      return "export";
+    case mem_cpu::HISTORY:     return "history";
+    default:                   return "?";
+  }
+}
+
+void track_cpu(mem_cpu subsystem, ssize_t delta) noexcept {
+  cpu[(uint)subsystem].add(delta);
+}
+
+void set_cpu(mem_cpu subsystem, size_t bytes) noexcept {
+  cpu[(uint)subsystem].set(bytes);
+}
+
+mem_usage cpu_usage(mem_cpu subsystem) noexcept {
+  if (subsystem == mem_cpu::CAPTURE) return { capture_buffers().live_bytes(), capture_buffers().peak_bytes() };
+  return { cpu[(uint)subsystem].live, cpu[(uint)subsystem].peak };
+}
+
+void track_gpu(const char* name, size_t bytes) noexcept {
+  std::lock_guard lock(gpu_mutex);
+
+  auto it = std::find_if(gpu_resources.begin(), gpu_resources.end(), [&](auto& r) { return r.first == name; });
+  if (it == gpu_resources.end()) it = gpu_resources.insert(gpu_resources.end(), { name, {} });
+
+  gpu_total.live = gpu_total.live - it->second.live + bytes;
+  gpu_total.peak = std::max(gpu_total.peak, gpu_total.live);
+
+  it->second.live = bytes;
+  it->second.peak = std::max(it->second.peak, bytes);
+}
+
+mem_usage gpu_usage() noexcept {
+  std::lock_guard lock(gpu_mutex);
+  return gpu_total;
+}
+
+size_t texture_bytes(int width, int height, int format, int mipmaps) noexcept {
+  size_t bytes = 0;
+
+  for (int level = 0; level < std::max(mipmaps, 1); level++) {
+    bytes += GetPixelDataSize(std::max(width >> level, 1), std::max(height >> level, 1), format);
+  }
+
+  return bytes;
+}
+
+void write_memory_json(FILE* out, uint width, uint height) noexcept {
+  fprintf(out, "{\n  \"resolution\": [%u, %u],\n", width, height);
+  fprintf(out, "  \"rss\": { \"live\": %zu, \"peak\": %zu },\n", current_rss_kb() * 1024, peak_rss_kb() * 1024);
+
+  fprintf(out, "  \"cpu\": {\n");
+  for (uint i = 0; i < (uint)mem_cpu::COUNT; i++) {
+    auto u = cpu_usage((mem_cpu)i);
+    fprintf(out, "    \"%s\": { \"live\": %zu, \"peak\": %zu }%s\n", mem_cpu_name((mem_cpu)i), u.live, u.peak, i + 1 < (uint)mem_cpu::COUNT ? "," : "");
+  }
+  fprintf(out, "  },\n");
+
+  std::lock_guard lock(gpu_mutex);
+
+  fprintf(out, "  \"gpu\": {\n    \"total\": { \"live\": %zu, \"peak\": %zu },\n    \"resources\": {\n", gpu_total.live, gpu_total.peak);
+  for (size_t i = 0; i < gpu_resources.size(); i++) {
+    auto& [name, u] = gpu_resources[i];
+    fprintf(out, "      \"%s\": { \"live\": %zu, \"peak\": %zu }%s\n", name.c_str(), u.live, u.peak, i + 1 < gpu_resources.size() ? "," : "");
+  }
+  fprintf(out, "    }\n  }\n}\n");
+}
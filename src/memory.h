@@ -0,0 +1,47 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdio>
+
+// Live and peak bytes per subsystem. CPU side is counted where the big buffers are
+// made, capture buffers by their pool (buffers.h). GPU side is estimated from size
+// and format of every texture, render target and buffer object we create.
+enum class mem_cpu : uint {
+  CAPTURE,     // capture pool buffers: screenshots, recapture, diff base, sessions
+  CONVERSION,  // X server replies and texture readbacks before they land in a capture buffer
+  ANNOTATIONS, // shapes, texts and their strings
+  EXPORT,      // rendered images until encoded, animation frames, video ring
+  HISTORY,     // touched part of the --history ring
+  COUNT,
+};
+
+struct mem_usage { size_t live, peak; };
+
+void track_cpu(mem_cpu subsystem, ssize_t delta) noexcept;
+
+// For memory held in containers that is measured rather than counted
+void set_cpu(mem_cpu subsystem, size_t bytes) noexcept;
+
+mem_usage cpu_usage(mem_cpu subsystem) noexcept;
+
+// Current size of a named GPU resource, 0 once it's unloaded
+void track_gpu(const char* name, size_t bytes) noexcept;
+
+// All GPU resources together
+mem_usage gpu_usage() noexcept;
+
+// raylib pixel format, all mip levels
+size_t texture_bytes(int width, int height, int format, int mipmaps = 1) noexcept;
+
+// Colour attachment plus the 24 bit depth renderbuffer raylib adds (32 bit in practice)
+inline size_t render_texture_bytes(int width, int height) noexcept { return (size_t)width * height * 8; }
+
+template <typename I>
+inline size_t image_bytes(const I& image) noexcept { return image.data ? texture_bytes(image.width, image.height, image.format, image.mipmaps) : 0; }
+
+// Everything above plus process RSS as one JSON object
+void write_memory_json(FILE* out, uint width, uint height) noexcept;
+
+const char* mem_cpu_name(mem_cpu subsystem) noexcept;
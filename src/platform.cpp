@@ -1,7 +1,15 @@
 #include "platform.h"
+#include "buffers.h"
+#include "jobs.h"
+#include "memory.h"
 
+#include <algorithm>
+#include <deque>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
+#include <vector>
 
 #ifdef DEBUG
   #include <chrono>
@@ -25,8 +33,23 @@
   #include <X11/Xutil.h>
 #endif
 
-#pragma pack(1)
-struct _color { u_char r, g, b; };
+// Rows per capture request, conversion of one band overlaps with receiving the next
+static constexpr uint CAPTURE_BAND = 128;
+
+void bgra_to_rgba(const u_char* src, u_char* dst, size_t pixels) noexcept {
+  // Word-wise swizzle, vectorizes into byte shuffles
+  const uint32_t* in = (const uint32_t*)src;
+  uint32_t* out = (uint32_t*)dst;
+
+  for (size_t i = 0; i < pixels; i++) {
+    uint32_t px = in[i];
+    out[i] = (px & 0x0000FF00) | ((px >> 16) & 0xFF) | ((px & 0xFF) << 16) | 0xFF000000;
+  }
+}
+
+void release_screenshot(u_char* data) noexcept {
+  capture_buffers().release(data);
+}
 
 #ifdef XCB_SCREENSHOT
   class xcb_conn {
@@ -50,6 +73,12 @@ struct _color { u_char r, g, b; };
     }
   };
 
+  // One connection for the whole process, xcb is thread safe
+  static xcb_conn& connection() noexcept {
+    static xcb_conn conn;
+    return conn;
+  }
+
   #define NAME2(A,B)         NAME2_HELPER(A,B)
   #define NAME2_HELPER(A,B)  A ## B
   #define CHECK_ERR(CONN, BODY) do { \
@@ -58,7 +87,7 @@ struct _color { u_char r, g, b; };
   } while (0)
 
   void raise_window(bool state) noexcept {
-    auto conn = xcb_conn();
+    auto& conn = connection();
 
     auto* focusReply = xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), nullptr);
     auto win = focusReply->focus;
@@ -85,7 +114,7 @@ struct _color { u_char r, g, b; };
 
   std::pair<uint, uint> get_screen_size() noexcept
   {
-    auto conn = xcb_conn();
+    auto& conn = connection();
     auto screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
 
     std::pair<uint, uint> pair = {
@@ -96,6 +125,70 @@ struct _color { u_char r, g, b; };
     return pair;
   }
 
+  static tile_rect clip(int x, int y, int width, int height, tile_rect bounds) noexcept {
+    int x0 = std::max<int>(x, bounds.x), y0 = std::max<int>(y, bounds.y);
+    int x1 = std::min<int>(x + width, bounds.x + bounds.width), y1 = std::min<int>(y + height, bounds.y + bounds.height);
+
+    if (x0 >= x1 || y0 >= y1) return {};
+    return { (uint)x0, (uint)y0, (uint)(x1 - x0), (uint)(y1 - y0) };
+  }
+
+  // Attributes, geometry and subtrees of all children go out before the first reply is read
+  static void walk_tree(xcb_connection_t* conn, xcb_query_tree_cookie_t tree_cookie, int origin_x, int origin_y, tile_rect bounds, uint depth, std::vector<tile_rect>& out) noexcept {
+    auto* tree = xcb_query_tree_reply(conn, tree_cookie, nullptr);
+    if (!tree) return;
+
+    const int count = xcb_query_tree_children_length(tree);
+    const xcb_window_t* children = xcb_query_tree_children(tree);
+
+    std::vector<xcb_get_window_attributes_cookie_t> attributes(count);
+    std::vector<xcb_get_geometry_cookie_t> geometries(count);
+
+    for (int i = 0; i < count; i++) {
+      attributes[i] = xcb_get_window_attributes(conn, children[i]);
+      geometries[i] = xcb_get_geometry(conn, children[i]);
+    }
+
+    struct viewable { xcb_window_t id; tile_rect rect; int x, y; xcb_query_tree_cookie_t subtree; };
+    std::vector<viewable> visible;
+
+    for (int i = 0; i < count; i++) {
+      auto* attrs = xcb_get_window_attributes_reply(conn, attributes[i], nullptr);
+      auto* geometry = xcb_get_geometry_reply(conn, geometries[i], nullptr);
+
+      if (attrs && geometry && attrs->map_state == XCB_MAP_STATE_VIEWABLE && attrs->_class == XCB_WINDOW_CLASS_INPUT_OUTPUT) {
+        int x = origin_x + geometry->x, y = origin_y + geometry->y, border = geometry->border_width;
+        auto rect = clip(x, y, geometry->width + 2 * border, geometry->height + 2 * border, bounds);
+
+        if (rect.width && rect.height) visible.push_back({ children[i], rect, x + border, y + border, {} });
+      }
+
+      free(attrs);
+      free(geometry);
+    }
+
+    free(tree);
+
+    const bool descend = depth + 1 < WINDOW_TREE_DEPTH;
+    if (descend) for (auto& v : visible) v.subtree = xcb_query_tree(conn, v.id);
+
+    // Children are stacked above their parent, below the parent's next sibling
+    for (auto& v : visible) {
+      out.push_back(v.rect);
+      if (descend) walk_tree(conn, v.subtree, v.x, v.y, v.rect, depth + 1, out);
+    }
+  }
+
+  std::vector<tile_rect> list_windows(std::pair<uint, uint> display_size) noexcept {
+    auto& conn = connection();
+    auto screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+
+    std::vector<tile_rect> out;
+    walk_tree(conn, xcb_query_tree(conn, screen->root), 0, 0, { 0, 0, display_size.first, display_size.second }, 0, out);
+
+    return out;
+  }
+
   // DEBUG
   // 60, 62, 79, 98, 88 - without pragma
   // 46, 95, 49, 62, 48 - with pragma
@@ -108,37 +201,81 @@ struct _color { u_char r, g, b; };
     auto start_time = std::chrono::high_resolution_clock::now();
   #endif
 
-    auto conn = xcb_conn();
+    auto& conn = connection();
     auto screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
 
-    auto get_image_task = xcb_get_image(
-      conn,
-      XCB_IMAGE_FORMAT_Z_PIXMAP,
-      screen->root,
-      0,
-      0,
-      display_size.first,
-      display_size.second,
-      ~0
-    );
+    const uint width  = display_size.first;
+    const uint height = display_size.second;
+    const uint bands  = (height + CAPTURE_BAND - 1) / CAPTURE_BAND;
+
+    std::vector<xcb_get_image_cookie_t> cookies(bands);
+
+    for (uint b = 0; b < bands; b++) {
+      cookies[b] = xcb_get_image(
+        conn,
+        XCB_IMAGE_FORMAT_Z_PIXMAP,
+        screen->root,
+        0,
+        b * CAPTURE_BAND,
+        width,
+        std::min(CAPTURE_BAND, height - b * CAPTURE_BAND),
+        ~0
+      );
+    }
+
+    u_char* data = capture_buffers().acquire((size_t)width * height * CAPTURE_BPP);
 
-    auto win_pixmap = xcb_generate_id(conn);
-    auto* image_reply = xcb_get_image_reply(conn, get_image_task, 0);
-    size_t l = xcb_get_image_data_length(image_reply);
+    if (!data) {
+      for (auto& c : cookies) xcb_discard_reply(conn, c.sequence);
+      LOG("No capture buffer for %ux%u\n", width, height);
+      return nullptr;
+    }
+
+    // Conversions keep to the job width like parallel_for does, so scaling benches see it
+    const uint converters = jobs().width() - 1;
+    std::deque<job_handle> converts;
+
+    for (uint b = 0; b < bands; b++) {
+      auto* image_reply = xcb_get_image_reply(conn, cookies[b], 0);
+      u_char* band = data + (size_t)b * CAPTURE_BAND * width * CAPTURE_BPP;
+      size_t pixels = (size_t)std::min(CAPTURE_BAND, height - b * CAPTURE_BAND) * width;
+
+      // A failed band fails the capture, black stripes would pass for screen content
+      if (!image_reply || xcb_get_image_data_length(image_reply) < pixels * 4) {
+        LOG("Band %u failed\n", b);
+        free(image_reply);
+
+        for (uint rest = b + 1; rest < bands; rest++) xcb_discard_reply(conn, cookies[rest].sequence);
+        for (auto& j : converts) jobs().wait(j);
+
+        capture_buffers().release(data);
+        return nullptr;
+      }
 
-    _color* data = new _color[display_size.first * display_size.second];
+      size_t l = xcb_get_image_data_length(image_reply);
+      track_cpu(mem_cpu::CONVERSION, sizeof(*image_reply) + l);
 
-    // BGRA 8 bit
-    u_char* image_data = xcb_get_image_data(image_reply);
+      // BGRA 8 bit, convert to RGBA while next band is in flight
+      auto convert = [=]() {
+        bgra_to_rgba(xcb_get_image_data(image_reply), band, pixels);
+        free(image_reply);
+        track_cpu(mem_cpu::CONVERSION, -(ssize_t)(sizeof(*image_reply) + l));
+      };
 
-    // Convert GBRA to RGBA
-    for (size_t i = 0; i < l; i += 4) {
-      data[i/4].r = image_data[i + 2]; // r
-      data[i/4].g = image_data[i + 1]; // g
-      data[i/4].b = image_data[i + 0]; // b
+      if (converters == 0) {
+        convert();
+        continue;
+      }
+
+      if (converts.size() >= converters) {
+        jobs().wait(converts.front());
+        converts.pop_front();
+      }
+
+      converts.push_back(jobs().submit(convert));
     }
 
-    free(image_reply);
+    for (auto& j : converts) jobs().wait(j);
 
   #ifdef DEBUG
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -148,7 +285,48 @@ struct _color { u_char r, g, b; };
     fflush(stdout);
   #endif
 
-    return (u_char*)data;
+    return data;
+  }
+  pointer_latch::pointer_latch(unsigned long window) noexcept {
+    auto* conn = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(conn)) {
+      xcb_disconnect(conn);
+      return;
+    }
+
+    // Event masks are per client, raylib's own selection on the window stays as it is
+    uint32_t mask = XCB_EVENT_MASK_POINTER_MOTION;
+    xcb_change_window_attributes(conn, window, XCB_CW_EVENT_MASK, &mask);
+    xcb_flush(conn);
+
+    _conn = conn;
+    _window = window;
+  }
+
+  pointer_latch::~pointer_latch() noexcept {
+    if (_conn) xcb_disconnect((xcb_connection_t*)_conn);
+  }
+
+  bool pointer_latch::poll(pointer_motion* motion) noexcept {
+    auto* conn = (xcb_connection_t*)_conn;
+    if (!conn) return false;
+
+    bool moved = false;
+
+    while (auto* event = xcb_poll_for_event(conn)) {
+      if ((event->response_type & ~0x80) == XCB_MOTION_NOTIFY) {
+        auto* m = (xcb_motion_notify_event_t*)event;
+
+        if (m->event == _window) {
+          *motion = { m->event_x, m->event_y, m->time };
+          moved = true;
+        }
+      }
+
+      free(event);
+    }
+
+    return moved;
   }
 #else
   void raise_window(void* handle) {
@@ -182,7 +360,81 @@ struct _color { u_char r, g, b; };
     return pair;
   }
 
+  static tile_rect clip(int x, int y, int width, int height, tile_rect bounds) noexcept {
+    int x0 = std::max<int>(x, bounds.x), y0 = std::max<int>(y, bounds.y);
+    int x1 = std::min<int>(x + width, bounds.x + bounds.width), y1 = std::min<int>(y + height, bounds.y + bounds.height);
+
+    if (x0 >= x1 || y0 >= y1) return {};
+    return { (uint)x0, (uint)y0, (uint)(x1 - x0), (uint)(y1 - y0) };
+  }
+
+  static void walk_tree(Display* display, Window parent, int origin_x, int origin_y, tile_rect bounds, uint depth, std::vector<tile_rect>& out) noexcept {
+    Window root, parent_return, *children = nullptr;
+    uint count = 0;
+
+    if (!XQueryTree(display, parent, &root, &parent_return, &children, &count)) return;
+
+    for (uint i = 0; i < count; i++) {
+      XWindowAttributes attrs;
+      if (!XGetWindowAttributes(display, children[i], &attrs)) continue;
+      if (attrs.map_state != IsViewable || attrs.c_class != InputOutput) continue;
+
+      int x = origin_x + attrs.x, y = origin_y + attrs.y, border = attrs.border_width;
+      auto rect = clip(x, y, attrs.width + 2 * border, attrs.height + 2 * border, bounds);
+      if (!rect.width || !rect.height) continue;
+
+      out.push_back(rect);
+      if (depth + 1 < WINDOW_TREE_DEPTH) walk_tree(display, children[i], x + border, y + border, rect, depth + 1, out);
+    }
+
+    if (children) XFree(children);
+  }
+
+  std::vector<tile_rect> list_windows(std::pair<uint, uint> display_size) noexcept {
+    auto display = XOpenDisplay(NULL);
+    std::vector<tile_rect> out;
+
+    walk_tree(display, DefaultRootWindow(display), 0, 0, { 0, 0, display_size.first, display_size.second }, 0, out);
+    XCloseDisplay(display);
+
+    return out;
+  }
+
   // DEBUG
+  pointer_latch::pointer_latch(unsigned long window) noexcept {
+    auto* display = XOpenDisplay(NULL);
+    if (!display) return;
+
+    XSelectInput(display, window, PointerMotionMask);
+    XFlush(display);
+
+    _conn = display;
+    _window = window;
+  }
+
+  pointer_latch::~pointer_latch() noexcept {
+    if (_conn) XCloseDisplay((Display*)_conn);
+  }
+
+  bool pointer_latch::poll(pointer_motion* motion) noexcept {
+    auto* display = (Display*)_conn;
+    if (!display) return false;
+
+    bool moved = false;
+
+    while (XPending(display)) {
+      XEvent event;
+      XNextEvent(display, &event);
+
+      if (event.type == MotionNotify && event.xmotion.window == _window) {
+        *motion = { event.xmotion.x, event.xmotion.y, (uint32_t)event.xmotion.time };
+        moved = true;
+      }
+    }
+
+    return moved;
+  }
+
   // 104, 136, 109, 129, 108 - without pragma
   // 74, 74, 121, 91, 95     - with pragma
   // RELASE
@@ -208,21 +460,47 @@ struct _color { u_char r, g, b; };
       ZPixmap
     );
 
-    _color* data = new _color[display_size.first * display_size.second];
+    if (!image) {
+      LOG("XGetImage failed\n");
+      XCloseDisplay(display);
+      return nullptr;
+    }
 
-    for (uint y = 0; y < display_size.second; y++) {
-      for (uint x = 0; x < display_size.first; x++) {
-        unsigned long pixel = XGetPixel(image, x, y);
-        auto ii = y*display_size.first + x;
+    const size_t reply_bytes = (size_t)image->bytes_per_line * image->height;
+    track_cpu(mem_cpu::CONVERSION, reply_bytes);
 
-        data[ ii ].r = (pixel & image->red_mask)   >> 16;
-        data[ ii ].g = (pixel & image->green_mask) >> 8;
-        data[ ii ].b = (pixel & image->blue_mask)  >> 0;
-      }
+    auto* data = (uint32_t*)capture_buffers().acquire((size_t)display_size.first * display_size.second * CAPTURE_BPP);
+
+    if (!data) {
+      XDestroyImage(image);
+      track_cpu(mem_cpu::CONVERSION, -(ssize_t)reply_bytes);
+      XCloseDisplay(display);
+      return nullptr;
     }
 
-    XCloseDisplay(display);
+    jobs().parallel_for(0, display_size.second, 64, [&](size_t begin, size_t end) {
+      for (uint y = begin; y < end; y++) {
+        if (image->bits_per_pixel == 32) {
+          bgra_to_rgba((u_char*)image->data + y * image->bytes_per_line, (u_char*)(data + y*display_size.first), display_size.first);
+          continue;
+        }
+
+        for (uint x = 0; x < display_size.first; x++) {
+          unsigned long pixel = XGetPixel(image, x, y);
+
+          data[ y*display_size.first + x ] =
+            ((pixel & image->red_mask)   >> 16) |
+            ((pixel & image->green_mask) >> 8)  << 8 |
+            ((pixel & image->blue_mask)  >> 0)  << 16 |
+            0xFF000000;
+        }
+      }
+    });
+
+    // Image belongs to the display connection, destroy it first
     XDestroyImage(image);
+    track_cpu(mem_cpu::CONVERSION, -(ssize_t)reply_bytes);
+    XCloseDisplay(display);
 
   #ifdef DEBUG
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -1,12 +1,58 @@
 #include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
 #include <utility>
+#include <vector>
+
+#include "tiles.h"
+
+// Captures are RGBA8, rows tightly packed, buffers come from capture_buffers()
+constexpr uint CAPTURE_BPP = 4;
 
 u_char*
 take_screenshot(std::pair<uint, uint> display_size) noexcept;
 
+void
+release_screenshot(u_char* data) noexcept;
+
+void
+bgra_to_rgba(const u_char* src, u_char* dst, size_t pixels) noexcept;
+
 std::pair<uint, uint>
 get_screen_size() noexcept;
 
+// Viewable windows down to WINDOW_TREE_DEPTH levels below root, clipped to their
+// parents and the screen, bottom to top (a window is followed by its children)
+constexpr uint WINDOW_TREE_DEPTH = 2;
+
+std::vector<tile_rect>
+list_windows(std::pair<uint, uint> display_size) noexcept;
+
+// Pointer motion over our window read off an X connection of its own, so the newest
+// position can be taken right before drawing without touching raylib's input state.
+// The window is the overlay's own, as GetWindowHandle() returns it.
+struct pointer_motion {
+  int x = 0, y = 0;
+
+  // X server milliseconds
+  uint32_t time = 0;
+};
+
+class pointer_latch {
+  void* _conn = nullptr;
+  unsigned long _window = 0;
+
+public:
+  explicit pointer_latch(unsigned long window) noexcept;
+  ~pointer_latch() noexcept;
+
+  pointer_latch(const pointer_latch&) = delete;
+  pointer_latch& operator=(const pointer_latch&) = delete;
+
+  // Newest motion since the last call, false when the pointer didn't move
+  bool poll(pointer_motion* motion) noexcept;
+};
+
 #ifdef XCB_SCREENSHOT
   #include <xcb/xcb.h>
   void raise_window(bool) noexcept;
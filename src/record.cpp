@@ -0,0 +1,291 @@
+#include "record.h"
+#include "jobs.h"
+#include "memory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <sys/wait.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <raylib.h>
+#include <rlgl.h>
+
+static inline double now_ms() noexcept {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+frame_ring::frame_ring(size_t slots, size_t frame_bytes) noexcept : _slots(slots), _frame_bytes(frame_bytes) {
+  for (auto& s : _slots) s.pixels = (u_char*)aligned_alloc(64, (frame_bytes + 63) / 64 * 64);
+  track_cpu(mem_cpu::EXPORT, slots * frame_bytes);
+}
+
+frame_ring::~frame_ring() noexcept {
+  for (auto& s : _slots) free(s.pixels);
+  track_cpu(mem_cpu::EXPORT, -(ssize_t)(_slots.size() * _frame_bytes));
+}
+
+u_char* frame_ring::write_slot() noexcept {
+  auto head = _head.load(std::memory_order_relaxed);
+  if (head - _tail.load(std::memory_order_acquire) == _slots.size()) return nullptr;
+
+  return _slots[head % _slots.size()].pixels;
+}
+
+void frame_ring::commit(double time) noexcept {
+  auto head = _head.load(std::memory_order_relaxed);
+  _slots[head % _slots.size()].time = time;
+
+  _head.store(head + 1, std::memory_order_release);
+}
+
+const u_char* frame_ring::read_slot(double* time) noexcept {
+  auto tail = _tail.load(std::memory_order_relaxed);
+  if (tail == _head.load(std::memory_order_acquire)) return nullptr;
+
+  *time = _slots[tail % _slots.size()].time;
+  return _slots[tail % _slots.size()].pixels;
+}
+
+void frame_ring::release() noexcept {
+  _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Half a second of 4K frames at most, but never less than a few slots
+static size_t ring_slots(size_t frame_bytes) noexcept {
+  return std::clamp<size_t>((512ull << 20) / frame_bytes, 4, 40);
+}
+
+recorder::recorder(const char* target, uint width, uint height, uint fps) noexcept
+  : _width(width & ~1u),
+    _height(height & ~1u),
+    _fps(fps),
+    _ring(ring_slots((size_t)width * height * 4), (size_t)(width & ~1u) * (height & ~1u) * 4) {
+  std::string path = target;
+
+  _format = path == "-" || path.starts_with("|") || path.ends_with(".y4m") ? format::Y4M : format::RAW;
+
+  // A consumer that goes away shows up as a failed write instead of killing us
+  if (path == "-" || path.starts_with("|")) signal(SIGPIPE, SIG_IGN);
+
+  if (path == "-") {
+    _out = stdout;
+  } else if (path.starts_with("|")) {
+    _out = popen(path.c_str() + 1, "w");
+    _pipe = true;
+  } else {
+    _out = fopen(path.c_str(), "wb");
+  }
+
+  if (!_out) {
+    fprintf(stderr, "Can't open record target: %s\n", target);
+    return;
+  }
+
+  // Frames are big, let stdio hand them to the kernel in one go
+  setvbuf(_out, nullptr, _IOFBF, 1 << 20);
+
+  if (_format == format::Y4M)
+    fprintf(_out, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n", _width, _height, _fps);
+
+  glGenBuffers(2, _pbo);
+  for (auto pbo : _pbo) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)_width * _height * 4, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  track_gpu("video readback", 2 * (size_t)_width * _height * 4);
+
+  // Dedicated thread: it spends its life blocked in write(), not a job for the pool
+  _encoder = std::thread([this]() { _encode_loop(); });
+}
+
+recorder::~recorder() noexcept {
+  finish();
+}
+
+void recorder::finish() noexcept {
+  if (!_encoder.joinable()) return;
+
+  // Encoder drains what's left in the ring first
+  _stop = true;
+  _encoder.join();
+
+  glDeleteBuffers(2, _pbo);
+  track_gpu("video readback", 0);
+
+  if (_pipe) {
+    int status = pclose(_out);
+    if (status != 0) fprintf(stderr, "record: command exited with status %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : status);
+  }
+  else if (_out != stdout) fclose(_out);
+  else fflush(_out);
+
+  if (_failed) fprintf(stderr, "record: writing stopped after %zu frames\n", _written.load());
+}
+
+void recorder::capture_frame() noexcept {
+  if (!ok()) return;
+
+  // Everything batched so far must hit the framebuffer before readback
+  rlDrawRenderBatchActive();
+
+  _rendered++;
+
+  auto current  = _pbo[_frame % 2];
+  auto previous = _pbo[(_frame + 1) % 2];
+
+  // A smaller window (TAB) leaves the rest of the frame as it was
+  const uint width  = std::min<uint>(_width, GetRenderWidth());
+  const uint height = std::min<uint>(_height, GetRenderHeight());
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glPixelStorei(GL_PACK_ROW_LENGTH, _width);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, current);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+  if (_frame++ > 0) {
+    auto occupancy = _ring.occupancy();
+    _occupancy_sum += occupancy;
+    _occupancy_max = std::max(_occupancy_max, occupancy);
+
+    if (auto* slot = _ring.write_slot()) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, previous);
+
+      if (auto* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)_width * _height * 4, GL_MAP_READ_BIT)) {
+        memcpy(slot, mapped, (size_t)_width * _height * 4);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        _ring.commit(GetTime());
+      }
+    } else {
+      _dropped++;
+    }
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void recorder::_to_y4m(const u_char* rgba, std::vector<u_char>& yuv) noexcept {
+  static constexpr char HEADER[] = "FRAME\n";
+  const size_t luma = (size_t)_width * _height;
+  const size_t chroma = luma / 4;
+  yuv.resize(sizeof(HEADER) - 1 + luma + chroma * 2);
+  memcpy(yuv.data(), HEADER, sizeof(HEADER) - 1);
+
+  u_char* Y = yuv.data() + sizeof(HEADER) - 1;
+  u_char* U = Y + luma;
+  u_char* V = U + chroma;
+
+  // BT.601 limited range, 2x2 blocks, framebuffer rows are bottom-up
+  jobs().parallel_for(0, _height / 2, 16, [&](size_t begin, size_t end) {
+    for (size_t cy = begin; cy < end; cy++) {
+      const u_char* rows[2] = {
+        rgba + (size_t)(_height - 1 - cy * 2) * _width * 4,
+        rgba + (size_t)(_height - 2 - cy * 2) * _width * 4,
+      };
+
+      for (uint dy = 0; dy < 2; dy++)
+        for (uint x = 0; x < _width; x++) {
+          int r = rows[dy][x * 4 + 0], g = rows[dy][x * 4 + 1], b = rows[dy][x * 4 + 2];
+          Y[(cy * 2 + dy) * _width + x] = (66 * r + 129 * g + 25 * b + 128 + (16 << 8)) >> 8;
+        }
+
+      for (uint cx = 0; cx < _width / 2; cx++) {
+        int r = 0, g = 0, b = 0;
+
+        for (uint dy = 0; dy < 2; dy++)
+          for (uint dx = 0; dx < 2; dx++) {
+            r += rows[dy][(cx * 2 + dx) * 4 + 0];
+            g += rows[dy][(cx * 2 + dx) * 4 + 1];
+            b += rows[dy][(cx * 2 + dx) * 4 + 2];
+          }
+
+        U[cy * (_width / 2) + cx] = ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+        V[cy * (_width / 2) + cx] = ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+      }
+    }
+  });
+}
+
+void recorder::_to_raw(const u_char* rgba, std::vector<u_char>& rows) noexcept {
+  const size_t stride = (size_t)_width * 4;
+  rows.resize(stride * _height);
+
+  for (uint y = 0; y < _height; y++)
+    memcpy(rows.data() + y * stride, rgba + (size_t)(_height - 1 - y) * stride, stride);
+}
+
+bool recorder::_emit(const std::vector<u_char>& frame) noexcept {
+  if (fwrite(frame.data(), 1, frame.size(), _out) == frame.size()) return true;
+
+  _failed = true;
+  return false;
+}
+
+void recorder::_encode_loop() noexcept {
+  std::vector<u_char> scratch;
+
+  // Output frame the next one goes into, counted from the time of the first one
+  double first_time = -1;
+  size_t next = 0;
+
+  while (true) {
+    double time;
+    auto* frame = _ring.read_slot(&time);
+
+    if (!frame) {
+      if (_stop) break;
+
+      // Producer never signals, at 80 FPS a 1ms poll is plenty
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    if (first_time < 0) first_time = time;
+    const size_t due = std::llround((time - first_time) * _fps);
+
+    if (_failed) {
+      // Nowhere to write, the ring is drained so finish() can return
+    } else if (due + 1 < next) {
+      _skipped++;
+    } else {
+      // Previous frame is still in scratch
+      for (; next < due && _written && _emit(scratch); next++, _written++) _repeated++;
+
+      auto start = now_ms();
+      if (_format == format::Y4M) _to_y4m(frame, scratch);
+      else _to_raw(frame, scratch);
+
+      if (_emit(scratch)) {
+        next = std::max(next, due) + 1;
+        _written++;
+      }
+
+      _encode_ms += now_ms() - start;
+    }
+
+    _ring.release();
+  }
+
+  fflush(_out);
+}
+
+void recorder::report(FILE* out) noexcept {
+  if (!_rendered) return;
+
+  fprintf(out,
+    "record: %ux%u, %zu frames rendered, %zu written, %zu dropped (ring full), %zu repeated, %zu skipped (ahead of %u FPS)\n"
+    "record: ring %zu slots, occupancy avg %.2f max %zu, encode+write %.2fms/frame\n",
+    _width, _height, _rendered, _written.load(), _dropped, _repeated, _skipped, _fps,
+    _ring.capacity(), _rendered > 1 ? (double)_occupancy_sum / (_rendered - 1) : 0.0, _occupancy_max,
+    _written ? _encode_ms / _written : 0.0);
+}
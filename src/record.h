@@ -0,0 +1,95 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Single producer (render loop) / single consumer (encoder) ring of
+// preallocated frames. Neither side ever blocks on the other: a full ring
+// makes the producer drop the frame.
+class frame_ring {
+  struct slot {
+    u_char* pixels;
+    double time;
+  };
+
+  std::vector<slot> _slots;
+  size_t _frame_bytes;
+
+  alignas(64) std::atomic<size_t> _head = 0; // next slot to write, owned by producer
+  alignas(64) std::atomic<size_t> _tail = 0; // next slot to read, owned by consumer
+
+public:
+  frame_ring(size_t slots, size_t frame_bytes) noexcept;
+  ~frame_ring() noexcept;
+
+  frame_ring(const frame_ring&) = delete;
+  frame_ring& operator=(const frame_ring&) = delete;
+
+  // Producer side, nullptr when the ring is full
+  u_char* write_slot() noexcept;
+  void commit(double time) noexcept;
+
+  // Consumer side, nullptr when the ring is empty, time is what the producer committed
+  const u_char* read_slot(double* time) noexcept;
+  void release() noexcept;
+
+  inline size_t occupancy() const noexcept { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+  inline size_t capacity() const noexcept { return _slots.size(); }
+};
+
+// Streams rendered frames as Y4M (4:2:0) or raw RGBA into a file, stdout
+// ("-") or a command ("|ffmpeg ..."). Readback is double buffered through
+// pixel buffer objects, so the frame read in this loop iteration is the
+// one rendered in the previous one. Output is constant frame rate: frames are
+// placed by their render time, gaps (slow frames, a full ring) repeat the
+// previous frame and frames more than one ahead of the clock are skipped.
+class recorder {
+  enum class format { Y4M, RAW };
+
+  uint _width, _height, _fps;
+  format _format;
+  FILE* _out = nullptr;
+  bool _pipe = false;
+
+  frame_ring _ring;
+  std::thread _encoder;
+  std::atomic<bool> _stop = false;
+
+  uint _pbo[2] = {};
+  uint _frame = 0;
+
+  // Producer stats
+  size_t _rendered = 0, _dropped = 0, _occupancy_sum = 0, _occupancy_max = 0;
+
+  // Consumer stats, write failure (a closed pipe) stops the stream
+  std::atomic<size_t> _written = 0;
+  size_t _repeated = 0, _skipped = 0;
+  double _encode_ms = 0;
+  std::atomic<bool> _failed = false;
+
+  void _encode_loop() noexcept;
+  void _to_y4m(const u_char* rgba, std::vector<u_char>& yuv) noexcept;
+  void _to_raw(const u_char* rgba, std::vector<u_char>& rows) noexcept;
+  bool _emit(const std::vector<u_char>& frame) noexcept;
+
+public:
+  recorder(const char* target, uint width, uint height, uint fps) noexcept;
+  ~recorder() noexcept;
+
+  recorder(const recorder&) = delete;
+  recorder& operator=(const recorder&) = delete;
+
+  inline bool ok() const noexcept { return _out != nullptr && !_failed; }
+
+  // Call after the frame is drawn, before EndDrawing()
+  void capture_frame() noexcept;
+
+  // Drains the ring and closes the target
+  void finish() noexcept;
+
+  void report(FILE* out) noexcept;
+};
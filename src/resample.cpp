@@ -0,0 +1,186 @@
+#include "resample.h"
+#include "buffers.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef __AVX2__
+  #include <immintrin.h>
+#endif
+
+static float lanczos3(float x) noexcept {
+  x = std::fabs(x);
+  if (x < 1e-6f) return 1;
+  if (x >= 3) return 0;
+
+  const float px = (float)M_PI * x;
+  return 3 * std::sin(px) * std::sin(px / 3) / (px * px);
+}
+
+static float catmull_rom(float x) noexcept {
+  x = std::fabs(x);
+  if (x < 1) return (1.5f * x - 2.5f) * x * x + 1;
+  if (x < 2) return ((-0.5f * x + 2.5f) * x - 4) * x + 2;
+  return 0;
+}
+
+// Taps of every output coordinate along one axis, weights sum to 1
+struct contributions {
+  uint taps = 0;
+  std::vector<uint> first = {};
+  std::vector<float> weights = {};
+
+  contributions(uint in, uint out, resample_filter filter) noexcept {
+    const float radius = filter == resample_filter::LANCZOS3 ? 3 : 2;
+    const float ratio = (float)in / out;
+
+    // Downscaling stretches the kernel over the source so it also low-passes
+    const float scale = std::max(ratio, 1.0f);
+    const float support = radius * scale;
+
+    taps = (uint)std::ceil(support) * 2 + 1;
+    first.resize(out);
+    weights.assign((size_t)out * taps, 0);
+
+    for (uint i = 0; i < out; i++) {
+      const float center = (i + 0.5f) * ratio;
+      const int lo = std::max(0, (int)std::floor(center - support));
+      const int hi = std::min((int)in, (int)std::ceil(center + support));
+
+      float* w = weights.data() + (size_t)i * taps;
+      float sum = 0;
+
+      for (int j = lo; j < hi && j - lo < (int)taps; j++) {
+        float x = (j + 0.5f - center) / scale;
+        w[j - lo] = filter == resample_filter::LANCZOS3 ? lanczos3(x) : catmull_rom(x);
+        sum += w[j - lo];
+      }
+
+      if (sum != 0) for (uint k = 0; k < taps; k++) w[k] /= sum;
+
+      // Window is shifted left at the right edge, its tail weights are 0 anyway
+      first[i] = (uint)std::min(lo, std::max(0, (int)in - (int)taps));
+      if ((uint)lo != first[i]) {
+        uint shift = lo - first[i];
+        std::memmove(w + shift, w, (taps - shift) * sizeof(float));
+        std::fill(w, w + shift, 0.0f);
+      }
+    }
+  }
+};
+
+static inline u_char clamp_channel(float v) noexcept {
+  return (u_char)std::clamp((int)std::lround(v), 0, 255);
+}
+
+static void horizontal_row(const u_char* src, u_char* dst, uint dst_width, uint src_width, const contributions& c) noexcept {
+  const uint taps = std::min(c.taps, src_width);
+
+  for (uint x = 0; x < dst_width; x++) {
+    const u_char* px = src + (size_t)c.first[x] * 4;
+    const float* w = c.weights.data() + (size_t)x * c.taps;
+    uint k = 0;
+
+#ifdef __AVX2__
+    // Two source pixels per step, one in each half
+    __m256 acc = _mm256_setzero_ps();
+
+    for (; k + 2 <= taps; k += 2) {
+      __m256 p  = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(px + k * 4))));
+      __m256 wk = _mm256_setr_m128(_mm_set1_ps(w[k]), _mm_set1_ps(w[k + 1]));
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(p, wk));
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+
+    for (; k < taps; k++) {
+      uint32_t one;
+      std::memcpy(&one, px + k * 4, 4);
+      __m128 p = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(one)));
+      sum = _mm_add_ps(sum, _mm_mul_ps(p, _mm_set1_ps(w[k])));
+    }
+
+    // Rounds to nearest, saturating packs clamp the overshoot of the kernel
+    __m128i v = _mm_cvtps_epi32(sum);
+    v = _mm_packus_epi16(_mm_packus_epi32(v, v), v);
+    uint32_t out = (uint32_t)_mm_cvtsi128_si32(v);
+    std::memcpy(dst + (size_t)x * 4, &out, 4);
+#else
+    float acc[4] = {};
+
+    for (; k < taps; k++)
+      for (uint ch = 0; ch < 4; ch++) acc[ch] += px[k * 4 + ch] * w[k];
+
+    for (uint ch = 0; ch < 4; ch++) dst[(size_t)x * 4 + ch] = clamp_channel(acc[ch]);
+#endif
+  }
+}
+
+static void vertical_row(const u_char* src, size_t stride, uint src_height, u_char* dst, size_t bytes, uint first, const float* w, uint taps) noexcept {
+  taps = std::min(taps, src_height);
+  const u_char* rows = src + (size_t)first * stride;
+  size_t i = 0;
+
+#ifdef __AVX2__
+  // 32 channels per step, packed back in order by the final permute
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  for (; i + 32 <= bytes; i += 32) {
+    __m256 a = _mm256_setzero_ps(), b = a, c = a, d = a;
+
+    for (uint k = 0; k < taps; k++) {
+      const u_char* row = rows + k * stride + i;
+      const __m256 wk = _mm256_set1_ps(w[k]);
+
+      a = _mm256_add_ps(a, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row +  0)))), wk));
+      b = _mm256_add_ps(b, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row +  8)))), wk));
+      c = _mm256_add_ps(c, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + 16)))), wk));
+      d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + 24)))), wk));
+    }
+
+    __m256i ab = _mm256_packus_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    __m256i cd = _mm256_packus_epi32(_mm256_cvtps_epi32(c), _mm256_cvtps_epi32(d));
+    __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order);
+
+    _mm256_storeu_si256((__m256i*)(dst + i), packed);
+  }
+#endif
+
+  for (; i < bytes; i++) {
+    float acc = 0;
+    for (uint k = 0; k < taps; k++) acc += rows[k * stride + i] * w[k];
+    dst[i] = clamp_channel(acc);
+  }
+}
+
+bool resample_rgba(
+  const u_char* src, uint src_width, uint src_height, size_t src_stride,
+  u_char* dst, uint dst_width, uint dst_height,
+  resample_filter filter
+) noexcept {
+  if (!src || !dst || !src_width || !src_height || !dst_width || !dst_height) return false;
+
+  const size_t mid_stride = (size_t)dst_width * 4;
+  u_char* mid = capture_buffers().acquire(mid_stride * src_height);
+  if (!mid) return false;
+
+  const contributions columns(src_width, dst_width, filter);
+  const contributions rows(src_height, dst_height, filter);
+
+  jobs().parallel_for(0, src_height, 16, [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; y++)
+      horizontal_row(src + y * src_stride, mid + y * mid_stride, dst_width, src_width, columns);
+  });
+
+  jobs().parallel_for(0, dst_height, 16, [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; y++)
+      vertical_row(mid, mid_stride, src_height, dst + y * mid_stride, mid_stride, rows.first[y], rows.weights.data() + y * rows.taps, rows.taps);
+  });
+
+  capture_buffers().release(mid);
+  return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+
+enum class resample_filter {
+  LANCZOS3, // sharpest, rings a little on hard edges
+  BICUBIC,  // Catmull-Rom
+};
+
+// Separable resize of RGBA8 pixels: a horizontal pass into an 8 bit intermediate of
+// dst_width x src_height, then a vertical one. Both passes run over rows in parallel.
+// src_stride is in bytes so a selection can be resized in place of the whole capture,
+// dst is tightly packed. Returns false when the intermediate can't be allocated.
+bool resample_rgba(
+  const u_char* src, uint src_width, uint src_height, size_t src_stride,
+  u_char* dst, uint dst_width, uint dst_height,
+  resample_filter filter = resample_filter::LANCZOS3
+) noexcept;
@@ -0,0 +1,282 @@
+#include "session.h"
+#include "buffers.h"
+#include "fileio.h"
+#include "jobs.h"
+#include "lz.h"
+#include "tiles.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char MAGIC[8] = { 'B', 'O', 'O', 'M', 'E', 'R', '2', 'S' };
+static constexpr uint32_t VERSION = 1;
+static constexpr size_t PAGE = 4096;
+static constexpr uint BPP = 4;
+
+// Common GL_MAX_TEXTURE_SIZE, larger captures couldn't be uploaded anyway
+static constexpr uint MAX_SIDE = 16384;
+
+enum class compression : uint32_t { NONE, LZ_TILES };
+
+enum section { CROSSHAIRS, LINES, ARROWS, RECTANGLES, REDACTIONS, TEXTS, STRINGS, SECTIONS };
+
+struct header {
+  char magic[8];
+  uint32_t version;
+  uint32_t width, height;
+  compression pixels_compression;
+
+  uint64_t pixels_offset, pixels_bytes;
+
+  // LZ_TILES: tile_entry per tile of tile_grid(width, height) in row order
+  uint64_t tiles_offset;
+  uint64_t tile_count;
+
+  uint64_t annotations_offset;
+  uint64_t counts[SECTIONS];
+
+  session_view view;
+};
+
+struct tile_entry {
+  uint64_t offset;
+  uint32_t bytes;
+  uint32_t _reserved;
+};
+
+static_assert(sizeof(header) <= PAGE);
+
+static inline size_t page_align(size_t n) noexcept { return (n + PAGE - 1) / PAGE * PAGE; }
+
+template <typename T>
+static size_t section_bytes(const T& v) noexcept { return v.size() * sizeof(v[0]); }
+
+bool save_session(const char* path, const session& s, bool compress) noexcept {
+  // Renamed over the old file once complete, a failed save leaves it intact
+  const std::string temp = std::string(path) + ".tmp";
+
+  int fd = open(temp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd < 0) return false;
+
+  header h = {};
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.width = s.width;
+  h.height = s.height;
+  h.pixels_offset = PAGE;
+  h.view = s.view;
+
+  bool ok = true;
+  const size_t frame_bytes = (size_t)s.width * s.height * BPP;
+
+  if (!compress) {
+    h.pixels_compression = compression::NONE;
+    h.pixels_bytes = frame_bytes;
+    ok &= write_all(fd, s.pixels, frame_bytes, h.pixels_offset);
+  } else {
+    h.pixels_compression = compression::LZ_TILES;
+
+    tile_grid grid(s.width, s.height, BPP);
+    const size_t count = (size_t)grid.cols * grid.rows;
+    std::vector<std::vector<u_char>> packed(count);
+
+    jobs().parallel_for(0, count, 16, [&](size_t begin, size_t end) {
+      std::vector<u_char> tile(TILE_SIZE * TILE_SIZE * BPP);
+
+      for (size_t t = begin; t < end; t++) {
+        auto r = grid.rect(t % grid.cols, t / grid.cols);
+        size_t bytes = (size_t)r.width * r.height * BPP;
+
+        pack_rect(s.pixels, s.width, BPP, r, tile.data());
+        packed[t].resize(lz_bound(bytes));
+        packed[t].resize(lz_compress(tile.data(), bytes, packed[t].data()));
+      }
+    });
+
+    std::vector<tile_entry> entries(count);
+    size_t offset = h.pixels_offset;
+
+    for (size_t t = 0; t < count; t++) {
+      entries[t] = { offset, (uint32_t)packed[t].size(), 0 };
+      ok &= write_all(fd, packed[t].data(), packed[t].size(), offset);
+      offset += packed[t].size();
+    }
+
+    h.pixels_bytes = offset - h.pixels_offset;
+    h.tiles_offset = offset;
+    h.tile_count = count;
+    ok &= write_all(fd, entries.data(), section_bytes(entries), offset);
+  }
+
+  h.annotations_offset = page_align(h.tile_count ? h.tiles_offset + h.tile_count * sizeof(tile_entry) : h.pixels_offset + h.pixels_bytes);
+
+  const std::pair<const void*, size_t> sections[SECTIONS] = {
+    { s.crosshairs.data(), section_bytes(s.crosshairs) },
+    { s.lines.data(),      section_bytes(s.lines) },
+    { s.arrows.data(),     section_bytes(s.arrows) },
+    { s.rectangles.data(), section_bytes(s.rectangles) },
+    { s.redactions.data(), section_bytes(s.redactions) },
+    { s.texts.data(),      section_bytes(s.texts) },
+    { s.strings.data(),    s.strings.size() },
+  };
+
+  h.counts[CROSSHAIRS] = s.crosshairs.size();
+  h.counts[LINES]      = s.lines.size();
+  h.counts[ARROWS]     = s.arrows.size();
+  h.counts[RECTANGLES] = s.rectangles.size();
+  h.counts[REDACTIONS] = s.redactions.size();
+  h.counts[TEXTS]      = s.texts.size();
+  h.counts[STRINGS]    = s.strings.size();
+
+  size_t offset = h.annotations_offset;
+  for (auto& [data, bytes] : sections) {
+    ok &= write_all(fd, data, bytes, offset);
+    offset += bytes;
+  }
+
+  // Without annotations nothing reaches annotations_offset, the file still has to
+  ok &= ftruncate(fd, offset) == 0;
+
+  // Header last, a torn write leaves no valid magic behind
+  ok &= write_all(fd, &h, sizeof(h), 0);
+  ok &= fsync(fd) == 0;
+  ok &= close(fd) == 0;
+
+  if (ok) ok = rename(temp.c_str(), path) == 0;
+  if (!ok) unlink(temp.c_str());
+
+  return ok;
+}
+
+template <typename T>
+static const u_char* take(std::vector<T>& v, const u_char* p, size_t count) noexcept {
+  v.resize(count);
+  if (count) memcpy(v.data(), p, count * sizeof(T));
+  return p + count * sizeof(T);
+}
+
+// Bytes at offset lie within a file of file_bytes, without overflowing on garbage
+static inline bool within(uint64_t offset, uint64_t bytes, uint64_t file_bytes) noexcept {
+  return offset <= file_bytes && bytes <= file_bytes - offset;
+}
+
+static u_char* load_tiles(int fd, const header& h, uint64_t file_bytes) noexcept {
+  tile_grid grid(h.width, h.height, BPP);
+  if (h.tile_count != (size_t)grid.cols * grid.rows || !within(h.tiles_offset, h.tile_count * sizeof(tile_entry), file_bytes))
+    return nullptr;
+
+  std::vector<tile_entry> entries(h.tile_count);
+  if (!read_all(fd, entries.data(), section_bytes(entries), h.tiles_offset)) return nullptr;
+
+  // Compressed pixels only, tile table is read above
+  u_char* compressed = capture_buffers().map_file(fd, h.pixels_offset, h.pixels_bytes);
+  u_char* pixels = capture_buffers().acquire((size_t)h.width * h.height * BPP);
+  std::atomic<bool> ok = compressed && pixels;
+
+  jobs().parallel_for(0, ok ? h.tile_count : 0, 16, [&](size_t begin, size_t end) {
+    std::vector<u_char> tile(TILE_SIZE * TILE_SIZE * BPP);
+
+    for (size_t t = begin; t < end; t++) {
+      auto r = grid.rect(t % grid.cols, t / grid.cols);
+      auto& e = entries[t];
+      size_t bytes = (size_t)r.width * r.height * BPP;
+
+      if (e.offset < h.pixels_offset || !within(e.offset - h.pixels_offset, e.bytes, h.pixels_bytes)
+          || !lz_decompress(compressed + (e.offset - h.pixels_offset), e.bytes, tile.data(), bytes)) {
+        ok = false;
+        continue;
+      }
+
+      for (uint y = 0; y < r.height; y++)
+        memcpy(pixels + ((size_t)(r.y + y) * h.width + r.x) * BPP, tile.data() + (size_t)y * r.width * BPP, (size_t)r.width * BPP);
+    }
+  });
+
+  capture_buffers().release(compressed);
+  if (ok) return pixels;
+
+  capture_buffers().release(pixels);
+  return nullptr;
+}
+
+bool load_session(const char* path, session* s) noexcept {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  header h;
+  struct stat st;
+
+  // Every size and count in the header is bounded by the file before it sizes an allocation or a read
+  if (fstat(fd, &st) || !read_all(fd, &h, sizeof(h), 0)
+      || memcmp(h.magic, MAGIC, sizeof(MAGIC)) || h.version != VERSION
+      || !h.width || !h.height || h.width > MAX_SIDE || h.height > MAX_SIDE
+      || h.pixels_offset % PAGE || h.annotations_offset % PAGE
+      || !within(h.pixels_offset, h.pixels_bytes, st.st_size)) {
+    close(fd);
+    return false;
+  }
+
+  size_t annotation_bytes = 0;
+  bool counts_fit = true;
+  const size_t record[SECTIONS] = {
+    sizeof(session_point), sizeof(session_shape), sizeof(session_shape), sizeof(session_shape),
+    sizeof(session_shape), sizeof(session_text), 1,
+  };
+
+  for (int i = 0; i < SECTIONS; i++) {
+    counts_fit &= h.counts[i] <= (uint64_t)st.st_size / record[i];
+    if (counts_fit) annotation_bytes += h.counts[i] * record[i];
+  }
+
+  // Sessions saved without annotations used to end before annotations_offset
+  if (!counts_fit || (annotation_bytes && !within(h.annotations_offset, annotation_bytes, st.st_size))) {
+    close(fd);
+    return false;
+  }
+
+  u_char* pixels = nullptr;
+
+  switch (h.pixels_compression) {
+    case compression::NONE:
+      if (h.pixels_bytes == (size_t)h.width * h.height * BPP)
+        pixels = capture_buffers().map_file(fd, h.pixels_offset, h.pixels_bytes);
+      break;
+
+    case compression::LZ_TILES:
+      pixels = load_tiles(fd, h, st.st_size);
+      break;
+  }
+
+  std::vector<u_char> annotations(annotation_bytes);
+  bool ok = pixels && read_all(fd, annotations.data(), annotation_bytes, h.annotations_offset);
+  close(fd);
+
+  if (!ok) {
+    capture_buffers().release(pixels);
+    return false;
+  }
+
+  s->width = h.width;
+  s->height = h.height;
+  s->pixels = pixels;
+  s->view = h.view;
+
+  const u_char* p = annotations.data();
+  p = take(s->crosshairs, p, h.counts[CROSSHAIRS]);
+  p = take(s->lines,      p, h.counts[LINES]);
+  p = take(s->arrows,     p, h.counts[ARROWS]);
+  p = take(s->rectangles, p, h.counts[RECTANGLES]);
+  p = take(s->redactions, p, h.counts[REDACTIONS]);
+  p = take(s->texts,      p, h.counts[TEXTS]);
+  s->strings.assign((const char*)p, h.counts[STRINGS]);
+
+  // Text records point into strings, drop any that don't
+  std::erase_if(s->texts, [&](const session_text& t) { return (size_t)t.offset + t.length > s->strings.size(); });
+
+  return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Session file, every section starts at a page boundary:
+//   header | pixels (raw RGBA, or LZ compressed 64x64 tiles + tile table) | annotations
+// Raw pixels are mapped and uploaded as they are, annotations are plain arrays.
+
+struct session_point { float x, y; };
+
+enum session_flags : uint32_t {
+  SESSION_FIRST    = 1,
+  SESSION_SECOND   = 2,
+  SESSION_PIXELATE = 4,
+};
+
+struct session_shape {
+  session_point first, second;
+  uint32_t flags;
+};
+
+struct session_text {
+  session_point position;
+  float size;
+  uint32_t offset, length;
+};
+
+struct session_view {
+  session_point target, offset;
+  float zoom;
+  session_shape selection;
+};
+
+struct session {
+  uint width = 0, height = 0;
+
+  // Capture buffer (see buffers.h), mapped from the file after load_session()
+  u_char* pixels = nullptr;
+
+  std::vector<session_point> crosshairs = {};
+  std::vector<session_shape> lines = {};
+  std::vector<session_shape> arrows = {};
+  std::vector<session_shape> rectangles = {};
+  std::vector<session_shape> redactions = {};
+  std::vector<session_text> texts = {};
+  std::string strings = {};
+
+  session_view view = {};
+};
+
+bool save_session(const char* path, const session& s, bool compress) noexcept;
+bool load_session(const char* path, session* s) noexcept;
@@ -0,0 +1,76 @@
+#include "startup.h"
+
+#include <algorithm>
+
+double startup_graph::_now() const noexcept {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _t0).count();
+}
+
+int startup_graph::add(const char* name, std::initializer_list<int> deps) noexcept {
+  std::lock_guard lock(_mutex);
+  _nodes.push_back({ name, deps });
+  return _nodes.size() - 1;
+}
+
+int startup_graph::submit(const char* name, std::initializer_list<int> deps, std::function<void()> fn) noexcept {
+  auto id = add(name, deps);
+
+  std::vector<job_handle> after;
+  for (auto dep : deps) after.push_back(job(dep));
+
+  auto j = jobs().submit_after([this, id, fn = std::move(fn)]() {
+    start(id);
+    fn();
+    finish(id);
+  }, after);
+
+  std::lock_guard lock(_mutex);
+  _nodes[id].job = j;
+  return id;
+}
+
+job_handle startup_graph::job(int id) noexcept {
+  std::lock_guard lock(_mutex);
+  return _nodes[id].job;
+}
+
+void startup_graph::start(int id) noexcept {
+  auto t = _now();
+  std::lock_guard lock(_mutex);
+  _nodes[id].start = t;
+}
+
+void startup_graph::finish(int id) noexcept {
+  auto t = _now();
+  std::lock_guard lock(_mutex);
+  _nodes[id].end = t;
+}
+
+void startup_graph::report(FILE* out, int last) noexcept {
+  std::lock_guard lock(_mutex);
+
+  std::vector<bool> critical(_nodes.size(), false);
+  for (int id = last; id >= 0;) {
+    critical[id] = true;
+
+    int blocker = -1;
+    for (auto dep : _nodes[id].deps)
+      if (blocker < 0 || _nodes[dep].end > _nodes[blocker].end) blocker = dep;
+
+    id = blocker;
+  }
+
+  fprintf(out, "%-16s %9s %9s %9s\n", "startup", "start", "end", "took");
+
+  for (size_t i = 0; i < _nodes.size(); i++) {
+    auto& n = _nodes[i];
+    if (n.end < 0) {
+      fprintf(out, "%-16s %9s\n", n.name, "pending");
+      continue;
+    }
+
+    fprintf(out, "%-16s %7.2fms %7.2fms %7.2fms%s\n", n.name, n.start, n.end, n.end - n.start, critical[i] ? "  *" : "");
+  }
+
+  fprintf(out, "critical path (*) to %s: %.2fms\n", _nodes[last].name, _nodes[last].end);
+}
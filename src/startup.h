@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+
+#include "jobs.h"
+
+// Startup steps, what they wait on and their timings. submit() schedules a step
+// as a job that starts once the jobs of its deps are done, run() waits for them
+// and runs the step on the calling thread (GL and window work). report() walks
+// back from a node along the latest finished dependency, which is the critical
+// path to that node.
+class startup_graph {
+  struct node {
+    const char* name;
+    std::vector<int> deps;
+    double start = -1, end = -1;
+    job_handle job = nullptr;
+  };
+
+  std::chrono::steady_clock::time_point _t0;
+  std::mutex _mutex;
+  std::vector<node> _nodes;
+
+  double _now() const noexcept;
+
+public:
+  startup_graph() noexcept : _t0(std::chrono::steady_clock::now()) {}
+
+  int add(const char* name, std::initializer_list<int> deps = {}) noexcept;
+  void start(int id) noexcept;
+  void finish(int id) noexcept;
+
+  int submit(const char* name, std::initializer_list<int> deps, std::function<void()> fn) noexcept;
+
+  // Job of a submitted step, null for the others
+  job_handle job(int id) noexcept;
+
+  template <typename F>
+  int run(const char* name, std::initializer_list<int> deps, F&& fn) noexcept {
+    for (auto dep : deps) jobs().wait(job(dep));
+
+    auto id = add(name, deps);
+    start(id);
+    fn();
+    finish(id);
+    return id;
+  }
+
+  void report(FILE* out, int last) noexcept;
+};
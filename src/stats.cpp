@@ -0,0 +1,147 @@
+#include "stats.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+// Rows per job when a fresh rectangle is large enough to fan out
+static constexpr size_t ROWS_GRAIN = 64;
+
+// Four sub-histograms per channel, neighbouring pixels land in different ones so
+// increments of equal values don't wait on each other's stores. Pixels are read
+// two at a time as 64 bit words.
+struct local_bins {
+  uint32_t bins[4][3][256];
+
+  void count(const u_char* row, uint width) noexcept {
+    uint x = 0;
+
+    for (; x + 4 <= width; x += 4) {
+      uint64_t a, b;
+      memcpy(&a, row + x * 4, 8);
+      memcpy(&b, row + x * 4 + 8, 8);
+
+      bins[0][0][a & 0xFF]++; bins[0][1][(a >> 8) & 0xFF]++;  bins[0][2][(a >> 16) & 0xFF]++;
+      bins[1][0][(a >> 32) & 0xFF]++; bins[1][1][(a >> 40) & 0xFF]++; bins[1][2][(a >> 48) & 0xFF]++;
+      bins[2][0][b & 0xFF]++; bins[2][1][(b >> 8) & 0xFF]++;  bins[2][2][(b >> 16) & 0xFF]++;
+      bins[3][0][(b >> 32) & 0xFF]++; bins[3][1][(b >> 40) & 0xFF]++; bins[3][2][(b >> 48) & 0xFF]++;
+    }
+
+    for (; x < width; x++)
+      for (uint c = 0; c < 3; c++) bins[0][c][row[x * 4 + c]]++;
+  }
+
+  void fold(uint32_t out[3][256], bool subtract) const noexcept {
+    for (uint c = 0; c < 3; c++)
+      for (uint v = 0; v < 256; v++) {
+        uint32_t n = bins[0][c][v] + bins[1][c][v] + bins[2][c][v] + bins[3][c][v];
+        out[c][v] = subtract ? out[c][v] - n : out[c][v] + n;
+      }
+  }
+};
+
+static void accumulate(channel_histogram& h, const u_char* frame, uint frame_width, tile_rect r, bool subtract) noexcept {
+  if (!r.width || !r.height) return;
+
+  std::mutex merge;
+
+  jobs().parallel_for(r.y, r.y + r.height, r.width >= 256 ? ROWS_GRAIN : r.height, [&](size_t begin, size_t end) {
+    local_bins local;
+    memset(&local, 0, sizeof(local));
+
+    for (size_t y = begin; y < end; y++)
+      local.count(frame + (y * frame_width + r.x) * 4, r.width);
+
+    std::lock_guard lock(merge);
+    local.fold(h.bins, subtract);
+  });
+
+  size_t n = (size_t)r.width * r.height;
+  h.pixels = subtract ? h.pixels - n : h.pixels + n;
+}
+
+void channel_histogram::add(const u_char* frame, uint frame_width, tile_rect r) noexcept {
+  accumulate(*this, frame, frame_width, r, false);
+}
+
+void channel_histogram::remove(const u_char* frame, uint frame_width, tile_rect r) noexcept {
+  accumulate(*this, frame, frame_width, r, true);
+}
+
+u_char channel_histogram::min(uint channel) const noexcept {
+  for (uint v = 0; v < 256; v++) if (bins[channel][v]) return v;
+  return 0;
+}
+
+u_char channel_histogram::max(uint channel) const noexcept {
+  for (uint v = 256; v-- > 0;) if (bins[channel][v]) return v;
+  return 0;
+}
+
+double channel_histogram::mean(uint channel) const noexcept {
+  if (!pixels) return 0;
+
+  uint64_t sum = 0;
+  for (uint v = 0; v < 256; v++) sum += (uint64_t)v * bins[channel][v];
+
+  return (double)sum / pixels;
+}
+
+static inline bool empty(tile_rect r) noexcept { return !r.width || !r.height; }
+
+static tile_rect intersect(tile_rect a, tile_rect b) noexcept {
+  uint x0 = std::max(a.x, b.x), y0 = std::max(a.y, b.y);
+  uint x1 = std::min(a.x + a.width, b.x + b.width), y1 = std::min(a.y + a.height, b.y + b.height);
+
+  if (x0 >= x1 || y0 >= y1) return {};
+  return { x0, y0, x1 - x0, y1 - y0 };
+}
+
+// a without i (i inside a): up to 4 strips, full width above and below, the rest left and right
+static uint subtract(tile_rect a, tile_rect i, tile_rect out[4]) noexcept {
+  uint n = 0;
+
+  if (i.y > a.y)                               out[n++] = { a.x, a.y, a.width, i.y - a.y };
+  if (i.y + i.height < a.y + a.height)         out[n++] = { a.x, i.y + i.height, a.width, a.y + a.height - i.y - i.height };
+  if (i.x > a.x)                               out[n++] = { a.x, i.y, i.x - a.x, i.height };
+  if (i.x + i.width < a.x + a.width)           out[n++] = { i.x + i.width, i.y, a.x + a.width - i.x - i.width, i.height };
+
+  return n;
+}
+
+void selection_stats::reset(const u_char* frame, uint frame_width) noexcept {
+  _frame = frame;
+  _frame_width = frame_width;
+  _rect = {};
+  _histogram = {};
+}
+
+void selection_stats::update(tile_rect r) noexcept {
+  _touched = 0;
+
+  if (!_frame) return;
+  if (r.x == _rect.x && r.y == _rect.y && r.width == _rect.width && r.height == _rect.height) return;
+
+  auto common = intersect(_rect, r);
+
+  size_t kept = (size_t)common.width * common.height;
+  size_t incremental = (size_t)_rect.width * _rect.height - kept + (size_t)r.width * r.height - kept;
+
+  // Strips would cost more than starting over (selection jumped somewhere else)
+  if (empty(common) || incremental >= (size_t)r.width * r.height) {
+    _histogram = {};
+    _histogram.add(_frame, _frame_width, r);
+    _touched = (size_t)r.width * r.height;
+    _rect = r;
+    return;
+  }
+
+  tile_rect strips[4];
+
+  for (uint i = 0, n = subtract(_rect, common, strips); i < n; i++) _histogram.remove(_frame, _frame_width, strips[i]);
+  for (uint i = 0, n = subtract(r, common, strips); i < n; i++)     _histogram.add(_frame, _frame_width, strips[i]);
+
+  _touched = incremental;
+  _rect = r;
+}
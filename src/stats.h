@@ -0,0 +1,46 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+#include "tiles.h"
+
+// R, G, B histograms of a rectangle of an RGBA8 frame. Min, max and mean come
+// from the bins, so the histogram can both grow and shrink.
+struct channel_histogram {
+  uint32_t bins[3][256] = {};
+  size_t pixels = 0;
+
+  void add(const u_char* frame, uint frame_width, tile_rect r) noexcept;
+  void remove(const u_char* frame, uint frame_width, tile_rect r) noexcept;
+
+  u_char min(uint channel) const noexcept;
+  u_char max(uint channel) const noexcept;
+  double mean(uint channel) const noexcept;
+};
+
+// Histogram of the selection, kept in sync with it by adding and removing
+// only the strips the edges moved over.
+class selection_stats {
+  channel_histogram _histogram;
+  tile_rect _rect = {};
+
+  const u_char* _frame = nullptr;
+  uint _frame_width = 0;
+
+  size_t _touched = 0;
+
+public:
+  // New capture, everything is recomputed on the next update
+  void reset(const u_char* frame, uint frame_width) noexcept;
+
+  void update(tile_rect r) noexcept;
+
+  inline const channel_histogram& histogram() const noexcept { return _histogram; }
+  inline tile_rect rect() const noexcept { return _rect; }
+  inline const u_char* frame() const noexcept { return _frame; }
+
+  // Pixels read by the last update
+  inline size_t touched() const noexcept { return _touched; }
+};
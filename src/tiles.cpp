@@ -0,0 +1,185 @@
+#include "tiles.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#ifdef __AVX2__
+  #include <immintrin.h>
+#endif
+
+// XXH3-style accumulator: 4x64 bit lanes, 32 byte stripes, scrambled after every row
+// so that row order matters. Scalar fallback produces the same values.
+
+static constexpr uint STRIPE = 32;
+static constexpr uint KEYS   = 8;
+static constexpr uint64_t PRIME32_1 = 0x9E3779B1u;
+
+static constexpr auto SECRET = []() {
+  std::array<uint64_t, KEYS * 4> secret = {};
+  uint64_t x = 0x243F6A8885A308D3ull;
+
+  for (auto& s : secret) {
+    // splitmix64
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    s = z ^ (z >> 31);
+  }
+
+  return secret;
+}();
+
+static inline uint64_t mix(uint64_t h) noexcept {
+  h ^= h >> 37;
+  h *= 0x165667919E3779F9ull;
+  return h ^ (h >> 32);
+}
+
+static inline void accumulate_scalar(uint64_t acc[4], const u_char* stripe, uint key) noexcept {
+  uint64_t data[4];
+  memcpy(data, stripe, sizeof(data));
+
+  for (uint i = 0; i < 4; i++) {
+    uint64_t data_key = data[i] ^ SECRET[key * 4 + i];
+    acc[i ^ 1] += data[i];
+    acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+  }
+}
+
+static inline void scramble_scalar(uint64_t acc[4]) noexcept {
+  for (uint i = 0; i < 4; i++) {
+    acc[i] ^= acc[i] >> 47;
+    acc[i] *= PRIME32_1;
+  }
+}
+
+uint64_t hash_tile(const u_char* pixels, size_t stride, size_t row_bytes, uint rows) noexcept {
+  alignas(32) uint64_t acc[4] = { PRIME32_1, 0x85EBCA77C2B2AE63ull, 0xC2B2AE3D27D4EB4Full, 0x27D4EB2F165667C5ull };
+  alignas(32) u_char tail[STRIPE];
+
+  const size_t full = row_bytes / STRIPE * STRIPE;
+
+#ifdef __AVX2__
+  __m256i vacc = _mm256_load_si256((const __m256i*)acc);
+  const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+
+  for (uint y = 0; y < rows; y++) {
+    const u_char* row = pixels + y * stride;
+    uint key = 0;
+
+    for (size_t x = 0; x < full; x += STRIPE, key = (key + 1) % KEYS) {
+      __m256i data     = _mm256_loadu_si256((const __m256i*)(row + x));
+      __m256i data_key = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i*)&SECRET[key * 4]));
+      __m256i product  = _mm256_mul_epu32(data_key, _mm256_srli_epi64(data_key, 32));
+      __m256i swapped  = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+      vacc = _mm256_add_epi64(vacc, _mm256_add_epi64(product, swapped));
+    }
+
+    if (full < row_bytes) {
+      memset(tail, 0, STRIPE);
+      memcpy(tail, row + full, row_bytes - full);
+      _mm256_store_si256((__m256i*)acc, vacc);
+      accumulate_scalar(acc, tail, key);
+      vacc = _mm256_load_si256((const __m256i*)acc);
+    }
+
+    // acc ^= acc >> 47; acc *= PRIME32_1 (64x32 bit multiply split into two 32x32)
+    vacc = _mm256_xor_si256(vacc, _mm256_srli_epi64(vacc, 47));
+    __m256i lo = _mm256_mul_epu32(vacc, prime);
+    __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(vacc, 32), prime);
+    vacc = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+  }
+
+  _mm256_store_si256((__m256i*)acc, vacc);
+#else
+  for (uint y = 0; y < rows; y++) {
+    const u_char* row = pixels + y * stride;
+    uint key = 0;
+
+    for (size_t x = 0; x < full; x += STRIPE, key = (key + 1) % KEYS)
+      accumulate_scalar(acc, row + x, key);
+
+    if (full < row_bytes) {
+      memset(tail, 0, STRIPE);
+      memcpy(tail, row + full, row_bytes - full);
+      accumulate_scalar(acc, tail, key);
+    }
+
+    scramble_scalar(acc);
+  }
+#endif
+
+  return mix(acc[0] ^ mix(acc[1]) ^ mix(mix(acc[2]) ^ acc[3]));
+}
+
+tile_grid::tile_grid(uint width, uint height, uint bpp) noexcept
+  : width(width),
+    height(height),
+    cols((width + TILE_SIZE - 1) / TILE_SIZE),
+    rows((height + TILE_SIZE - 1) / TILE_SIZE),
+    bpp(bpp),
+    hashes(cols * rows) {}
+
+void tile_grid::compute(const u_char* pixels) noexcept {
+  const size_t stride = (size_t)width * bpp;
+
+  jobs().parallel_for(0, rows, 1, [&](size_t begin, size_t end) {
+    for (uint row = begin; row < end; row++)
+      for (uint col = 0; col < cols; col++) {
+        auto r = rect(col, row);
+        hashes[row * cols + col] = hash_tile(pixels + r.y * stride + (size_t)r.x * bpp, stride, (size_t)r.width * bpp, r.height);
+      }
+  });
+}
+
+std::vector<tile_rect> tile_grid::diff(const tile_grid& prev) const noexcept {
+  std::vector<tile_rect> runs = {};
+
+  if (!same_layout(prev)) {
+    runs.push_back({ 0, 0, width, height });
+    return runs;
+  }
+
+  for (uint row = 0; row < rows; row++) {
+    uint col = 0;
+
+    while (col < cols) {
+      if (hashes[row * cols + col] == prev.hashes[row * cols + col]) { col++; continue; }
+
+      uint begin = col;
+      while (col < cols && hashes[row * cols + col] != prev.hashes[row * cols + col]) col++;
+
+      auto first = rect(begin, row);
+      auto last  = rect(col - 1, row);
+      runs.push_back({ first.x, first.y, last.x + last.width - first.x, first.height });
+    }
+  }
+
+  return runs;
+}
+
+void pack_rect(const u_char* pixels, uint frame_width, uint bpp, tile_rect r, u_char* out) noexcept {
+  const size_t stride = (size_t)frame_width * bpp;
+  const size_t row_bytes = (size_t)r.width * bpp;
+
+  for (uint y = 0; y < r.height; y++)
+    memcpy(out + y * row_bytes, pixels + (r.y + y) * stride + (size_t)r.x * bpp, row_bytes);
+}
+
+void pack_rects(const u_char* pixels, uint frame_width, uint bpp, const std::vector<tile_rect>& rects, std::vector<u_char>& out, std::vector<size_t>& offsets) noexcept {
+  offsets.resize(rects.size());
+
+  size_t total = 0;
+  for (size_t i = 0; i < rects.size(); i++) {
+    offsets[i] = total;
+    total += (size_t)rects[i].width * rects[i].height * bpp;
+  }
+
+  out.resize(total);
+
+  jobs().parallel_for(0, rects.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) pack_rect(pixels, frame_width, bpp, rects[i], out.data() + offsets[i]);
+  });
+}
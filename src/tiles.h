@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+constexpr uint TILE_SIZE = 64;
+
+struct tile_rect { uint x, y, width, height; };
+
+// Per-tile content hashes of one capture, used to find what changed between captures.
+struct tile_grid {
+  uint width = 0, height = 0;
+  uint cols = 0, rows = 0;
+  uint bpp = 0;
+
+  std::vector<uint64_t> hashes = {};
+
+  tile_grid() noexcept = default;
+  tile_grid(uint width, uint height, uint bpp) noexcept;
+
+  void compute(const u_char* pixels) noexcept;
+
+  inline tile_rect rect(uint col, uint row) const noexcept {
+    uint x = col * TILE_SIZE, y = row * TILE_SIZE;
+    return { x, y, std::min(TILE_SIZE, width - x), std::min(TILE_SIZE, height - y) };
+  }
+
+  inline bool same_layout(const tile_grid& other) const noexcept
+  { return width == other.width && height == other.height && bpp == other.bpp; }
+
+  // Changed tiles merged into horizontal runs, one rectangle per run.
+  std::vector<tile_rect> diff(const tile_grid& prev) const noexcept;
+};
+
+uint64_t hash_tile(const u_char* pixels, size_t stride, size_t row_bytes, uint rows) noexcept;
+
+// Copy rect out of a full frame into a tightly packed buffer for partial texture updates.
+void pack_rect(const u_char* pixels, uint frame_width, uint bpp, tile_rect r, u_char* out) noexcept;
+
+// pack_rect for every rect into one buffer in parallel, offsets[i] is where rect i starts.
+void pack_rects(const u_char* pixels, uint frame_width, uint bpp, const std::vector<tile_rect>& rects, std::vector<u_char>& out, std::vector<size_t>& offsets) noexcept;
@@ -0,0 +1,44 @@
+#include "wintree.h"
+
+#include <algorithm>
+
+window_index::window_index(std::vector<tile_rect> windows, uint width, uint height) noexcept
+  : _windows(std::move(windows)),
+    _cols((width + TILE_SIZE - 1) / TILE_SIZE),
+    _rows((height + TILE_SIZE - 1) / TILE_SIZE),
+    _starts((size_t)_cols * _rows + 1, 0) {
+  auto cells = [&](const tile_rect& w, auto&& fn) {
+    uint c0 = w.x / TILE_SIZE, c1 = std::min(_cols, (w.x + w.width + TILE_SIZE - 1) / TILE_SIZE);
+    uint r0 = w.y / TILE_SIZE, r1 = std::min(_rows, (w.y + w.height + TILE_SIZE - 1) / TILE_SIZE);
+
+    for (uint r = r0; r < r1; r++)
+      for (uint c = c0; c < c1; c++) fn((size_t)r * _cols + c);
+  };
+
+  // Count, prefix sum, then fill walking windows top to bottom
+  for (auto& w : _windows) cells(w, [&](size_t cell) { _starts[cell + 1]++; });
+  for (size_t c = 0; c + 1 < _starts.size(); c++) _starts[c + 1] += _starts[c];
+
+  _entries.resize(_starts.back());
+  std::vector<uint> fill(_starts.begin(), _starts.end() - 1);
+
+  for (uint i = _windows.size(); i-- > 0;)
+    cells(_windows[i], [&](size_t cell) { _entries[fill[cell]++] = i; });
+}
+
+const tile_rect* window_index::at(float x, float y) const noexcept {
+  if (x < 0 || y < 0 || _starts.empty()) return nullptr;
+
+  uint px = x, py = y;
+  uint col = px / TILE_SIZE, row = py / TILE_SIZE;
+  if (col >= _cols || row >= _rows) return nullptr;
+
+  size_t cell = (size_t)row * _cols + col;
+
+  for (uint e = _starts[cell]; e < _starts[cell + 1]; e++) {
+    auto& w = _windows[_entries[e]];
+    if (px >= w.x && py >= w.y && px < w.x + w.width && py < w.y + w.height) return &w;
+  }
+
+  return nullptr;
+}
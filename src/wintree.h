@@ -0,0 +1,29 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <vector>
+
+#include "tiles.h"
+
+// Window rectangles bucketed into a TILE_SIZE grid. Every cell lists the windows
+// overlapping it topmost first, so a lookup checks a handful of rectangles.
+class window_index {
+  std::vector<tile_rect> _windows = {};
+  uint _cols = 0, _rows = 0;
+
+  // Cell c owns _entries[_starts[c] .. _starts[c + 1])
+  std::vector<uint> _starts = {};
+  std::vector<uint> _entries = {};
+
+public:
+  window_index() noexcept = default;
+
+  // windows bottom to top, as list_windows() returns them
+  window_index(std::vector<tile_rect> windows, uint width, uint height) noexcept;
+
+  // Topmost window containing the point, nullptr when none does
+  const tile_rect* at(float x, float y) const noexcept;
+
+  inline size_t size() const noexcept { return _windows.size(); }
+};
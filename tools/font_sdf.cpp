@@ -0,0 +1,87 @@
+// Generates src/font_sdf.h: signed distance field of the Terminus atlas from font.h,
+// same layout and glyph recs, so it can be drawn with DrawTextEx at any scale.
+//
+//   font_sdf > src/font_sdf.h
+
+#include <raylib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "../src/font.h"
+
+static constexpr int WIDTH = 512, HEIGHT = 256;
+
+// Distance in atlas pixels mapped onto the full byte range, limited by glyph padding
+static constexpr int SPREAD = 4;
+
+int main() {
+  int size = 0;
+  unsigned char* gray_alpha = DecompressData(fontData_Terminus, COMPRESSED_DATA_SIZE_FONT_TERMINUS, &size);
+
+  if (!gray_alpha || size < WIDTH * HEIGHT * 2) {
+    fprintf(stderr, "font_sdf: can't inflate font data\n");
+    return 1;
+  }
+
+  auto inside = [&](int x, int y) { return gray_alpha[(y * WIDTH + x) * 2 + 1] > 127; };
+
+  std::vector<unsigned char> sdf(WIDTH * HEIGHT, 0);
+
+  for (auto& r : fontRecs_Terminus) {
+    const int x0 = r.x, y0 = r.y, x1 = r.x + r.width, y1 = r.y + r.height;
+
+    // Source pixels are unit squares, distances are from sample centres to square edges
+    for (int y = std::max(0, y0 - SPREAD); y < std::min(HEIGHT, y1 + SPREAD); y++)
+      for (int x = std::max(0, x0 - SPREAD); x < std::min(WIDTH, x1 + SPREAD); x++) {
+        const bool in = x >= x0 && x < x1 && y >= y0 && y < y1 && inside(x, y);
+        const float px = x + 0.5f, py = y + 0.5f;
+        float best = SPREAD;
+
+        for (int sy = y0 - 1; sy <= y1; sy++)
+          for (int sx = x0 - 1; sx <= x1; sx++) {
+            const bool s_in = sx >= x0 && sx < x1 && sy >= y0 && sy < y1 && inside(sx, sy);
+            if (s_in == in) continue;
+
+            float dx = std::max({ sx - px, 0.0f, px - (sx + 1) });
+            float dy = std::max({ sy - py, 0.0f, py - (sy + 1) });
+            best = std::min(best, std::sqrt(dx * dx + dy * dy));
+          }
+
+        float d = in ? best : -best;
+        sdf[y * WIDTH + x] = (unsigned char)std::clamp(std::lround(127.5f + d * 127.5f / SPREAD), 0l, 255l);
+      }
+  }
+
+  MemFree(gray_alpha);
+
+  printf("// Generated by tools/font_sdf.cpp from font.h, do not edit\n\n");
+  printf("#define FONT_SDF_WIDTH_TERMINUS %d\n", WIDTH);
+  printf("#define FONT_SDF_HEIGHT_TERMINUS %d\n", HEIGHT);
+  printf("#define FONT_SDF_SPREAD_TERMINUS %d\n\n", SPREAD);
+  printf("// Signed distance, 128 on glyph edges, inside is brighter\n");
+  printf("static const unsigned char fontSdf_Terminus[%d] = {", WIDTH * HEIGHT);
+
+  for (int i = 0; i < WIDTH * HEIGHT; i++) printf("%s0x%02x,", i % 20 ? " " : "\n    ", sdf[i]);
+
+  printf("\n};\n\n");
+  printf("// Needs fontRecs_Terminus and fontGlyphs_Terminus from font.h\n");
+  printf("static Font LoadFontSdf_Terminus(void)\n");
+  printf("{\n");
+  printf("    Font font = { 0 };\n\n");
+  printf("    font.baseSize = 32;\n");
+  printf("    font.glyphCount = 95;\n");
+  printf("    font.glyphPadding = 4;\n\n");
+  printf("    Image imFont = { (void*)fontSdf_Terminus, FONT_SDF_WIDTH_TERMINUS, FONT_SDF_HEIGHT_TERMINUS, 1, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE };\n\n");
+  printf("    // Distances are interpolated between texels, that's what keeps edges sharp when magnified\n");
+  printf("    font.texture = LoadTextureFromImage(imFont);\n");
+  printf("    SetTextureFilter(font.texture, TEXTURE_FILTER_BILINEAR);\n\n");
+  printf("    font.recs = (Rectangle*)fontRecs_Terminus;\n");
+  printf("    font.glyphs = (GlyphInfo*)fontGlyphs_Terminus;\n\n");
+  printf("    return font;\n");
+  printf("}\n");
+
+  return 0;
+}
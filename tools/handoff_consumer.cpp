@@ -0,0 +1,133 @@
+// Reference consumer of --out-socket / --out-fd exports (see src/handoff.h). Maps every
+// handed off memfd read only, prints what it got and optionally keeps it in a directory
+// (raw exports as PAM, PNG ones as they are).
+//
+//   handoff_consumer <socket path> [out dir]              listen, boomer2 --out-socket <path>
+//   handoff_consumer --spawn [out dir] -- <boomer2> ...   run boomer2 with --out-fd on a socketpair
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../src/handoff.h"
+
+static void keep(const char* dir, const handoff_header& h, const u_char* data) {
+  char path[4096];
+  bool raw = h.format == (uint32_t)handoff_format::RAW;
+  snprintf(path, sizeof(path), "%s/%06u.%s", dir, h.seq, raw ? "pam" : "png");
+
+  FILE* out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return;
+  }
+
+  if (raw) {
+    fprintf(out, "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", h.width, h.height);
+    for (uint y = 0; y < h.height; y++) fwrite(data + (size_t)y * h.stride, 4, h.width, out);
+  } else {
+    fwrite(data, 1, h.bytes, out);
+  }
+
+  fclose(out);
+}
+
+// Every handoff on a connected socket until the peer closes it
+static void consume(int socket, const char* dir) {
+  handoff_header h;
+
+  for (int fd; (fd = handoff_receive(socket, &h)) >= 0; close(fd)) {
+    size_t total = h.offset + h.bytes;
+    auto* map = (const u_char*)mmap(nullptr, total, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED) {
+      perror("mmap");
+      continue;
+    }
+
+    printf("#%u %ux%u %s, %.1f KiB, sealed %s\n", h.seq, h.width, h.height,
+      h.format == (uint32_t)handoff_format::RAW ? "raw" : "png", h.bytes / 1024.0,
+      fcntl(fd, F_GET_SEALS) & F_SEAL_WRITE ? "yes" : "no");
+    fflush(stdout);
+
+    if (dir) keep(dir, h, map + h.offset);
+    munmap((void*)map, total);
+  }
+}
+
+static int listen_on(const char* path, const char* dir) {
+  int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+
+  if (server < 0 || bind(server, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(server, 8) != 0) {
+    perror(path);
+    return 1;
+  }
+
+  for (;;) {
+    int client = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) continue;
+
+    consume(client, dir);
+    close(client);
+  }
+}
+
+static int spawn(const char* dir, char** argv) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    perror("socketpair");
+    return 1;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    // Child end survives exec, ours doesn't
+    fcntl(fds[1], F_SETFD, 0);
+
+    std::string fd = std::to_string(fds[1]);
+    std::vector<char*> args;
+    for (char** a = argv; *a; a++) args.push_back(*a);
+    args.push_back((char*)"--out-fd");
+    args.push_back(fd.data());
+    args.push_back(nullptr);
+
+    execvp(args[0], args.data());
+    perror(args[0]);
+    _exit(127);
+  }
+
+  close(fds[1]);
+  consume(fds[0], dir);
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 4 && !strcmp(argv[1], "--spawn")) {
+    int sep = 2;
+    while (sep < argc && strcmp(argv[sep], "--")) sep++;
+    if (sep + 1 < argc) return spawn(sep > 2 ? argv[2] : nullptr, argv + sep + 1);
+  } else if (argc >= 2) {
+    return listen_on(argv[1], argc >= 3 ? argv[2] : nullptr);
+  }
+
+  fprintf(stderr,
+    "usage: %s <socket path> [out dir]\n"
+    "       %s --spawn [out dir] -- <boomer2> [args...]\n", argv[0], argv[0]);
+  return 2;
+}